@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGNMENT 16
+
+Arena *create_new_arena(size_t size) {
+    Arena *arena = malloc(sizeof(Arena));
+    arena->memory = malloc(size);
+    arena->size = size;
+    arena->used = 0;
+    return arena;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    size_t start = (arena->used + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+    if (start + size > arena->size) {
+        printf("Arena out of memory: %zu of %zu bytes used, %zu requested\n", arena->used, arena->size, size);
+        exit(1);
+    }
+    arena->used = start + size;
+    return arena->memory + start;
+}
+
+void reset_arena(Arena *arena) {
+    arena->used = 0;
+}
+
+void free_arena(Arena *arena) {
+    free(arena->memory);
+    free(arena);
+}
@@ -0,0 +1,19 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator. Allocations are never freed one at a time; the whole arena
+// is emptied with reset_arena once everything in it is finished with.
+typedef struct {
+    char * memory;
+    size_t size;
+    size_t used;
+} Arena;
+
+Arena * create_new_arena(size_t size);
+void * arena_alloc(Arena *arena, size_t size);
+void reset_arena(Arena *arena);
+void free_arena(Arena *arena);
+
+#endif
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "bench.h"
+
+static uint64_t now_in_nanoseconds() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return ((uint64_t) time.tv_sec * 1000000000) + time.tv_nsec;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of an already sorted array
+static double percentile(double *sorted, int length, int percent) {
+    int index = ((percent * length) + 99) / 100 - 1;
+    if (index < 0) {
+        index = 0;
+    }
+    return sorted[index];
+}
+
+void print_benchmark_header() {
+    printf("%-40s %8s %12s %12s %12s %12s\n", "benchmark", "samples", "mean ns/op", "p50", "p90", "p99");
+}
+
+void run_benchmark(char *name, Benchmark_Function setup, Benchmark_Function body, void *data, int operations, int samples) {
+    double *nanoseconds_per_operation = malloc(sizeof(double) * samples);
+    double total = 0;
+    for (int i = 0; i < samples; i++) {
+        if (setup) {
+            setup(data);
+        }
+        uint64_t start = now_in_nanoseconds();
+        body(data);
+        uint64_t end = now_in_nanoseconds();
+        nanoseconds_per_operation[i] = (double) (end - start) / operations;
+        total += nanoseconds_per_operation[i];
+    }
+    qsort(nanoseconds_per_operation, samples, sizeof(double), compare_doubles);
+    printf("%-40s %8d %12.1f %12.1f %12.1f %12.1f\n",
+           name,
+           samples,
+           total / samples,
+           percentile(nanoseconds_per_operation, samples, 50),
+           percentile(nanoseconds_per_operation, samples, 90),
+           percentile(nanoseconds_per_operation, samples, 99));
+    free(nanoseconds_per_operation);
+}
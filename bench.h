@@ -0,0 +1,11 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// setup runs untimed before every sample, body is timed and is expected to
+// perform `operations` operations so results come out in ns/op.
+typedef void (*Benchmark_Function)(void *data);
+
+void print_benchmark_header();
+void run_benchmark(char *name, Benchmark_Function setup, Benchmark_Function body, void *data, int operations, int samples);
+
+#endif
@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "bucket_queue.h"
+
+static int coordinate_key(Bucket_Queue *q, struct Coordinate coord) {
+    return (coord.y * q->width) + coord.x;
+}
+
+static void link_key(Bucket_Queue *q, int key, int priority) {
+    int bucket = priority % q->number_of_buckets;
+    q->priorities[key] = priority;
+    q->previous[key] = -1;
+    q->next[key] = q->heads[bucket];
+    if (q->heads[bucket] != -1) {
+        q->previous[q->heads[bucket]] = key;
+    }
+    q->heads[bucket] = key;
+}
+
+static void unlink_key(Bucket_Queue *q, int key) {
+    int bucket = q->priorities[key] % q->number_of_buckets;
+    if (q->previous[key] != -1) {
+        q->next[q->previous[key]] = q->next[key];
+    }
+    else {
+        q->heads[bucket] = q->next[key];
+    }
+    if (q->next[key] != -1) {
+        q->previous[q->next[key]] = q->previous[key];
+    }
+    q->priorities[key] = -1;
+}
+
+Bucket_Queue *create_new_bucket_queue(int max_weight, int width, int height) {
+    Bucket_Queue *q = malloc(sizeof(Bucket_Queue));
+    q->length = 0;
+    q->width = width;
+    q->number_of_buckets = max_weight + 1;
+    q->current_priority = 0;
+    q->heads = malloc(sizeof(int) * q->number_of_buckets);
+    for (int i = 0; i < q->number_of_buckets; i++) {
+        q->heads[i] = -1;
+    }
+    q->next = malloc(sizeof(int) * width * height);
+    q->previous = malloc(sizeof(int) * width * height);
+    q->priorities = malloc(sizeof(int) * width * height);
+    for (int i = 0; i < width * height; i++) {
+        q->priorities[i] = -1;
+    }
+    return q;
+}
+
+void free_bucket_queue(Bucket_Queue *q) {
+    free(q->heads);
+    free(q->next);
+    free(q->previous);
+    free(q->priorities);
+    free(q);
+}
+
+void bucket_insert_with_priority(Bucket_Queue *q, struct Coordinate coord, int priority) {
+    int key = coordinate_key(q, coord);
+    if (q->priorities[key] != -1) {
+        bucket_decrease_priority(q, coord, priority);
+        return;
+    }
+    if (q->length == 0 || priority < q->current_priority) {
+        q->current_priority = priority;
+    }
+    link_key(q, key, priority);
+    q->length ++;
+}
+
+Node bucket_extract_min(Bucket_Queue *q) {
+    int bucket = q->current_priority % q->number_of_buckets;
+    while (q->heads[bucket] == -1) {
+        q->current_priority ++;
+        bucket = q->current_priority % q->number_of_buckets;
+    }
+    int key = q->heads[bucket];
+    Node min;
+    min.distance = 0;
+    min.sequence = 0;
+    min.priority = q->priorities[key];
+    min.coord.x = key % q->width;
+    min.coord.y = key / q->width;
+    unlink_key(q, key);
+    q->length --;
+    return min;
+}
+
+void bucket_decrease_priority(Bucket_Queue *q, struct Coordinate coord, int priority) {
+    int key = coordinate_key(q, coord);
+    if (q->priorities[key] == -1 || priority >= q->priorities[key]) {
+        return;
+    }
+    unlink_key(q, key);
+    link_key(q, key, priority);
+}
@@ -0,0 +1,28 @@
+#ifndef BUCKET_QUEUE_H
+#define BUCKET_QUEUE_H
+
+#include "priority_queue.h"
+
+// Circular bucket queue (Dial's algorithm) for graphs whose edge weights are
+// small integers no larger than max_weight. Every queued priority has to stay
+// within max_weight of the last extracted one, which holds for Dijkstra.
+// Each coordinate is in at most one bucket, linked through next/previous, so
+// inserting a coordinate that is already queued just lowers its priority.
+typedef struct {
+    int length;
+    int width;
+    int number_of_buckets;
+    int current_priority;
+    int * heads;
+    int * next;
+    int * previous;
+    int * priorities;
+} Bucket_Queue;
+
+Bucket_Queue * create_new_bucket_queue(int max_weight, int width, int height);
+void free_bucket_queue(Bucket_Queue *q);
+void bucket_insert_with_priority(Bucket_Queue *q, struct Coordinate coord, int priority);
+Node bucket_extract_min(Bucket_Queue *q);
+void bucket_decrease_priority(Bucket_Queue *q, struct Coordinate coord, int priority);
+
+#endif
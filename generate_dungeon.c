@@ -6,12 +6,27 @@
 #include <unistd.h>
 #include <time.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <math.h>
 #include <ncurses.h>
 #include <netinet/in.h>
 #include <limits.h>
+#include <signal.h>
+#include <errno.h>
+#include <dirent.h>
 
 #include "priority_queue.h"
+#include "bucket_queue.h"
+#include "arena.h"
+#include "rng.h"
+#include "bench.h"
+#include "thread_pool.h"
+#include "run_length.h"
+#include "journal.h"
+#include "level_cache.h"
 
 #define HEIGHT 105
 #define WIDTH 160
@@ -22,18 +37,67 @@
 #define ROOM 0
 #define CORRIDOR 0
 #define MIN_NUMBER_OF_ROOMS 10
-#define MAX_NUMBER_OF_ROOMS 50
+#define MAX_NUMBER_OF_ROOMS MAX_ROOMS_PER_LEVEL
 #define MIN_ROOM_WIDTH 7
 #define DEFAULT_MAX_ROOM_WIDTH 15
 #define MIN_ROOM_HEIGHT 5
 #define DEFAULT_MAX_ROOM_HEIGHT 10
 #define DEFAULT_NUMBER_OF_MONSTERS 5
+#define MAX_TUNNELING_WEIGHT 3
+#define FRONTIER_SIZE (HEIGHT * WIDTH)
+#define TURN_ARENA_SIZE (64 * 1024)
+#define MAX_ROOMS_PER_LEVEL 256
+#define MAX_ROOM_ATTEMPTS 1000
+#define ROOM_MAP_WORDS ((WIDTH + 63) / 64)
+#define STREAM_TERRAIN 1
+#define STREAM_ROOMS 2
+#define STREAM_MONSTERS 3
+#define STREAM_AI 4
+#define BENCHMARK_SEED 327
+#define SAVE_FILE_MARKER "RLG327-S2017"
+#define SAVE_FILE_MARKER_SIZE 12
+#define SAVE_HEADER_SIZE 20
+#define SAVE_ROOM_SIZE 4
+#define SAVE_MONSTER_SIZE 6
+#define SAVE_QUEUE_ENTRY_SIZE 6
+#define SAVE_ROCK_UNCHANGED 0
+#define SAVE_ROCK_DUG 255
+#define JOURNAL_MARKER "RLG327-J2017"
+#define JOURNAL_MARKER_SIZE 12
+#define JOURNAL_HEADER_SIZE 28
+#define JOURNAL_KEY 'K'
+#define JOURNAL_KEY_SIZE 3
+#define JOURNAL_TURN 'T'
+#define JOURNAL_TURN_SIZE 5
+#define JOURNAL_STOP 'S'
+#define JOURNAL_STOP_SIZE 1
+#define JOURNAL_CHECKPOINT_TURNS 1000
+#define JOURNAL_USES_AUTOPILOT 1
+#define JOURNAL_USES_SCRIPT 2
+#define DEFAULT_LEVEL_CACHE_KILOBYTES 1024
+
+#define UNREACHABLE UINT16_MAX
+
+enum Cell_Type {
+    TYPE_ROCK,
+    TYPE_ROOM,
+    TYPE_CORRIDOR,
+    TYPE_UPSTAIR,
+    TYPE_DOWNSTAIR,
+    NUMBER_OF_CELL_TYPES
+};
+
+// Indexed by Cell_Type
+static const char CELL_GLYPHS[NUMBER_OF_CELL_TYPES] = {
+    ' ',
+    '.',
+    '#',
+    '<',
+    '>'
+};
 
-static char * TYPE_ROOM = "room";
-static char * TYPE_CORRIDOR = "corridor";
-static char * TYPE_ROCK = "rock";
-static char * TYPE_UPSTAIR = "upstair";
-static char * TYPE_DOWNSTAIR = "downstair";
+// Indexed by a monster's decimal_type
+static const char MONSTER_GLYPHS[] = "0123456789abcdef";
 
 struct Monster {
     uint8_t x;
@@ -48,20 +112,19 @@ struct Available_Coords {
     int length;
 };
 
+// One dense plane per attribute, so pathfinding only streams hardness and a
+// distance plane, and rendering only streams type and monster_at.
+// monster_at holds the index into monsters plus one, or zero for no monster.
 typedef struct {
-    int tunneling_distance;
-    int non_tunneling_distance;
-    int hardness;
-    char * type;
-    uint8_t x;
-    uint8_t y;
-    uint8_t has_player;
-    uint8_t has_monster;
-    struct Monster monster;
-} Board_Cell;
+    uint8_t hardness[HEIGHT][WIDTH];
+    uint8_t type[HEIGHT][WIDTH];
+    uint16_t tunneling_distance[HEIGHT][WIDTH];
+    uint16_t non_tunneling_distance[HEIGHT][WIDTH];
+    uint16_t monster_at[HEIGHT][WIDTH];
+} Board;
 
 typedef struct {
-    Board_Cell * cells;
+    struct Coordinate coords[8];
     int length;
 } Neighbors;
 
@@ -72,27 +135,159 @@ struct Room {
     uint8_t end_y;
 };
 
-Board_Cell board[HEIGHT][WIDTH];
-struct Coordinate placeable_areas[HEIGHT * WIDTH];
+// Everything one level of one game needs. Nothing in here is shared, so two
+// dungeons can be generated, played or pathfound side by side, including on
+// different threads. Options parsed from the command line stay global since
+// they are only read once the dungeons exist.
+typedef struct {
+    Board board;
+    struct Coordinate placeable_areas[HEIGHT * WIDTH];
+    struct Coordinate non_tunneling_frontier[FRONTIER_SIZE];
+    struct Room * rooms;
+    struct Monster * monsters;
+    struct Coordinate player;
+    Queue * game_queue;
+    Bucket_Queue * tunneling_bucket_queue;
+    Queue * tunneling_heap_queue;
+    Thread_Pool * distance_map_pool;
+    Level_Cache * level_cache;
+    // The levels above and below, built by the level worker ahead of time
+    Thread_Pool * level_worker;
+    struct Next_Level * next_levels;
+    Arena * turn_arena;
+    Arena * level_arena;
+    Rng terrain_rng;
+    Rng rooms_rng;
+    Rng monsters_rng;
+    Rng ai_rng;
+    // The terrain stream as it was just before it filled this level's rock,
+    // so saves can store hardness as the difference from that rock
+    Rng rock_rng;
+    int has_rock_rng;
+    int player_is_alive;
+    int depth;
+    int tunneling_map_is_stale;
+    int non_tunneling_map_is_stale;
+    int number_of_rooms;
+    // How many rooms a new level asks for, which a crowded board can leave it
+    // short of, so it is kept apart from number_of_rooms
+    int rooms_per_level;
+    int number_of_monsters;
+    // How many monsters a new level starts with, whatever is left alive on
+    // this one
+    int monsters_per_level;
+    int number_of_placeable_areas;
+} Dungeon;
+
+// A level for a depth next to the current one, built in a dungeon of its own
+// so the level worker never touches the game. The rest of the fields are
+// what it was built from, and it is only used if they still match the game
+// when the stairs are taken.
+typedef struct Next_Level {
+    Dungeon * dungeon;
+    uint8_t * level;
+    size_t size;
+    int depth;
+    int rooms_per_level;
+    int monsters_per_level;
+    Rng terrain_rng;
+    Rng rooms_rng;
+    Rng monsters_rng;
+} Next_Level;
+
+typedef struct {
+    int size;
+    Queue * queue;
+    int * priorities;
+} Queue_Benchmark;
+
+typedef struct {
+    Dungeon * dungeon;
+    char * filepath;
+} Board_Benchmark;
+
+typedef struct {
+    int worker;
+    int number_of_workers;
+    int failed;
+} Batch_Worker;
+
+// Records from a crashed game's journal that are still to be fed back in.
+// start is where records begins in the journal file.
+typedef struct {
+    uint8_t * records;
+    size_t length;
+    size_t offset;
+    size_t start;
+} Journal_Replay;
+
+// A level as it is in memory, for the level cache, followed by its game queue
+// nodes in insertion order, its monsters and its rooms. Much bigger than a
+// version 1 file, but it only takes copying to make and to restore.
+typedef struct {
+    uint8_t hardness[HEIGHT][WIDTH];
+    uint8_t type[HEIGHT][WIDTH];
+    Rng rock_rng;
+    int has_rock_rng;
+    struct Coordinate player;
+    int number_of_rooms;
+    int number_of_monsters;
+    int queue_length;
+} Level_Image;
+
+// Reads big-endian fields out of a mapped save file. A read past the end
+// returns zeros and sets overran, so a loader only has to check once.
+typedef struct {
+    uint8_t * bytes;
+    size_t length;
+    size_t offset;
+    int overran;
+} Save_Reader;
+
 struct Coordinate ncurses_player_coord;
 struct Coordinate ncurses_start_coord;
-struct Room * rooms;
-struct Monster * monsters;
-struct Coordinate player;
+// What the board part of the screen currently shows, so update_board_view
+// only has to draw the cells that changed since the last frame.
+chtype board_view_frame[NCURSES_HEIGHT + 1][NCURSES_WIDTH + 1];
+int BOARD_VIEW_IS_VALID = 0;
+// The crash journal of the game being played: a snapshot followed by every
+// key pressed and a check at the end of every turn since it was taken.
+Journal * game_journal = NULL;
+Journal_Replay journal_replay;
+int journal_turns = 0;
 char * RLG_DIRECTORY;
-Queue * game_queue;
+uint64_t SEED;
+FILE * SCRIPT_FILE = NULL;
+char * BATCH_DIRECTORY = NULL;
+char * RECORD_FILE = NULL;
+char * REPLAY_FILE = NULL;
 
 int IS_CONTROL_MODE = 1;
 int DO_QUIT = 0;
-int PLAYER_IS_ALIVE = 1;
 int DO_SAVE = 0;
 int DO_LOAD = 0;
+int DO_RECOVER = 0;
 int SHOW_HELP = 0;
+int USE_BUCKET_QUEUE = 1;
+int USE_MAP_WORKERS = 0;
+int USE_LEVEL_WORKER = 0;
+int DO_COMPARE_DISTANCES = 0;
+int HAS_SEED = 0;
+int HAS_NUMBER_OF_ROOMS = 0;
+int HAS_NUMBER_OF_MONSTERS = 0;
+int IS_HEADLESS = 0;
+int DO_BENCHMARK = 0;
+int USE_AUTOPILOT = 0;
+int DO_FAST_FORWARD = 0;
+int BATCH_SIZE = 0;
+int BATCH_WORKERS = 0;
+int MAX_TURNS = 0;
+int LEVEL_CACHE_KILOBYTES = DEFAULT_LEVEL_CACHE_KILOBYTES;
+int STOP_AT_TURN = 0;
 int NUMBER_OF_ROOMS = MIN_NUMBER_OF_ROOMS;
 int MAX_ROOM_WIDTH = DEFAULT_MAX_ROOM_WIDTH;
 int MAX_ROOM_HEIGHT = DEFAULT_MAX_ROOM_HEIGHT;
 int NUMBER_OF_MONSTERS = DEFAULT_NUMBER_OF_MONSTERS;
-int NUMBER_OF_PLACEABLE_AREAS = 0;
 
 int max(int x, int y) {
     if (x > y) {
@@ -107,39 +302,114 @@ int min(int x, int y) {
     return y;
 }
 void print_usage();
+void open_script_file(char * path);
+int get_next_key();
+int read_script_key();
+void print_headless_report(Dungeon * dungeon, int turns, int monster_moves, double seconds);
 void make_rlg_directory();
 void update_number_of_rooms();
-void generate_new_board();
-void generate_stairs();
-int random_int(int min_num, int max_num, int add_to_seed);
-void initialize_board();
-void initialize_immutable_rock();
-void load_board();
-void save_board();
-void place_player();
-void set_placeable_areas();
-void set_tunneling_distance_to_player();
-void set_non_tunneling_distance_to_player();
-void generate_monsters();
-void print_non_tunneling_board();
-void print_tunneling_board();
+Dungeon * create_new_dungeon(int number_of_rooms, int number_of_monsters);
+void free_dungeon(Dungeon * dungeon);
+void generate_new_board(Dungeon * dungeon);
+void load_new_board(Dungeon * dungeon);
+Level_Cache * get_level_cache(Dungeon * dungeon);
+void remove_stale_spill_files();
+void change_level(Dungeon * dungeon, int depth);
+uint8_t * capture_level(Dungeon * dungeon, size_t * size);
+int restore_level(Dungeon * dungeon, uint8_t * level, size_t size);
+int unpack_level(Dungeon * dungeon, uint8_t * level, size_t size);
+Next_Level * get_next_level(Dungeon * dungeon, int depth);
+Next_Level * get_next_level_slot(Dungeon * dungeon, int depth);
+void set_next_level_source(Dungeon * dungeon, Next_Level * next, int depth);
+int next_level_is_current(Dungeon * dungeon, Next_Level * next, int depth);
+void build_next_level(Next_Level * next);
+void build_next_level_task(void * data);
+void prepare_next_levels(Dungeon * dungeon);
+void free_next_levels(Dungeon * dungeon);
+void populate_board(Dungeon * dungeon);
+void generate_stairs(Dungeon * dungeon);
+void seed_random_streams(Dungeon * dungeon, uint64_t seed);
+void initialize_board(Dungeon * dungeon);
+void generate_rock(Rng * rng, uint8_t hardness[][WIDTH]);
+void initialize_immutable_rock(uint8_t hardness[][WIDTH]);
+int load_board(Dungeon * dungeon);
+int load_board_from(Dungeon * dungeon, char * filepath);
+int load_board_bytes(Dungeon * dungeon, uint8_t * file, size_t size, char * filepath);
+int load_game_state(Dungeon * dungeon, uint8_t * bytes, size_t length, int version);
+int read_save_level(Save_Reader * reader, Dungeon * dungeon);
+int read_save_cached_levels(Save_Reader * reader, Dungeon * dungeon);
+void save_board(Dungeon * dungeon);
+int save_board_to(Dungeon * dungeon, char * filepath);
+int save_game_to(Dungeon * dungeon, char * filepath);
+uint8_t * encode_game(Dungeon * dungeon, size_t offset, uint32_t * size);
+size_t get_encoded_level_size_bound(Dungeon * dungeon);
+uint8_t * put_level(uint8_t * out, Dungeon * dungeon);
+uint8_t * put_cached_levels(uint8_t * buffer, uint8_t ** out, Level_Cache * cache);
+int compare_node_sequence(const void * node1, const void * node2);
+void reserve_level_arena(Dungeon * dungeon, int number_of_monsters);
+void place_player(Dungeon * dungeon);
+void set_placeable_areas(Dungeon * dungeon);
+void set_tunneling_distance_to_player(Dungeon * dungeon);
+void set_tunneling_distance_with_bucket_queue(Dungeon * dungeon);
+void set_tunneling_distance_with_priority_queue(Dungeon * dungeon);
+void spread_tunneling_distance(Dungeon * dungeon);
+void repair_tunneling_distance_at(Dungeon * dungeon, struct Coordinate coord);
+void spread_non_tunneling_distance_from(Dungeon * dungeon, struct Coordinate source);
+void repair_non_tunneling_distance_at(Dungeon * dungeon, struct Coordinate coord);
+int dig_into_cell(Dungeon * dungeon, struct Coordinate coord);
+void mark_distance_maps_stale(Dungeon * dungeon);
+void update_tunneling_distance_if_stale(Dungeon * dungeon);
+void update_non_tunneling_distance_if_stale(Dungeon * dungeon);
+void update_distance_maps_if_stale(Dungeon * dungeon);
+void compare_tunneling_distances(Dungeon * dungeon);
+void set_non_tunneling_distance_to_player(Dungeon * dungeon);
+void generate_monsters(Dungeon * dungeon);
+void print_non_tunneling_board(Dungeon * dungeon);
+void print_tunneling_board(Dungeon * dungeon);
 void add_message(char* message);
-void center_board_on_player();
-int handle_user_input(int key);
-void handle_user_input_for_look_mode(int key);
-void print_board();
-void print_cell();
-void dig_rooms(int number_of_rooms_to_dig);
-void dig_room(int index, int recursive_iteration);
-int room_is_valid_at_index(int index);
-void add_rooms_to_board();
-void dig_cooridors();
-void connect_rooms_at_indexes(int index1, int index2);
-int get_monster_index(struct Coordinate coord);
-void move_player();
-struct Room get_room_player_is_in();
-void move_monster_at_index(int index);
-void kill_player_or_monster_at(struct Coordinate coord);
+void invalidate_board_view();
+void center_board_on_player(Dungeon * dungeon);
+int handle_user_input(Dungeon * dungeon, int key);
+void handle_user_input_for_look_mode(Dungeon * dungeon, int key);
+void print_board(Dungeon * dungeon);
+void assemble_board_row(Dungeon * dungeon, int y, int start_x, int length, chtype * glyphs);
+void dig_rooms(Dungeon * dungeon, int number_of_rooms_to_dig);
+int dig_room(Dungeon * dungeon, int index, uint64_t room_map[][ROOM_MAP_WORDS]);
+int room_is_valid(struct Room room, uint64_t room_map[][ROOM_MAP_WORDS]);
+int room_map_has(uint64_t room_map[][ROOM_MAP_WORDS], int x, int y);
+void add_room_to_map(struct Room room, uint64_t room_map[][ROOM_MAP_WORDS]);
+void add_rooms_to_board(Dungeon * dungeon);
+void dig_cooridors(Dungeon * dungeon);
+void connect_rooms_at_indexes(Dungeon * dungeon, int index1, int index2);
+int get_monster_index(Dungeon * dungeon, struct Coordinate coord);
+void move_player(Dungeon * dungeon);
+struct Room get_room_player_is_in(Dungeon * dungeon);
+int move_monster_at_index(Dungeon * dungeon, int index);
+void kill_player_or_monster_at(Dungeon * dungeon, struct Coordinate coord);
+void start_fresh_level(Dungeon * dungeon, uint64_t seed);
+char * get_journal_path();
+int get_journal_flags();
+int process_is_running(int pid);
+char * find_journal_to_recover();
+void checkpoint_journal(Dungeon * dungeon);
+int recover_from_journal(Dungeon * dungeon);
+int start_journal_replay(Dungeon * dungeon, char * filepath);
+void stop_at_turn(int turn);
+void finish_journal_replay();
+void stop_journal();
+void end_journal();
+int next_journal_key();
+int next_journal_stop();
+void record_journal_stop();
+void record_journal_key(int key);
+void record_journal_turn(Dungeon * dungeon);
+void append_journal_record(uint8_t * record, size_t size);
+void generate_batch();
+void * generate_batch_levels(void * data);
+uint64_t get_batch_level_seed(int index);
+void run_benchmarks();
+void run_queue_benchmarks(int size);
+void run_offscreen_view_benchmark(Board_Benchmark * benchmark);
 
 int main(int argc, char *args[]) {
     int player_x = -1;
@@ -147,10 +417,26 @@ int main(int argc, char *args[]) {
     struct option longopts[] = {
         {"save", no_argument, &DO_SAVE, 1},
         {"load", no_argument, &DO_LOAD, 1},
+        {"recover", no_argument, &DO_RECOVER, 1},
         {"rooms", required_argument, 0, 'r'},
         {"nummon", required_argument, 0, 'm'},
         {"player_x", required_argument, 0, 'x'},
         {"player_y", required_argument, 0, 'y'},
+        {"heap", no_argument, &USE_BUCKET_QUEUE, 0},
+        {"compare_distances", no_argument, &DO_COMPARE_DISTANCES, 1},
+        {"seed", required_argument, 0, 's'},
+        {"headless", no_argument, &IS_HEADLESS, 1},
+        {"script", required_argument, 0, 'i'},
+        {"turns", required_argument, 0, 't'},
+        {"bench", no_argument, &DO_BENCHMARK, 1},
+        {"generate-batch", required_argument, 0, 'b'},
+        {"out", required_argument, 0, 'o'},
+        {"threads", required_argument, 0, 'w'},
+        {"record", required_argument, 0, 'e'},
+        {"replay", required_argument, 0, 'p'},
+        {"fast-forward", no_argument, &DO_FAST_FORWARD, 1},
+        {"stop-at-turn", required_argument, 0, 'n'},
+        {"level-cache", required_argument, 0, 'l'},
         {"help", no_argument, &SHOW_HELP, 'h'},
         {0, 0, 0, 0}
     };
@@ -159,9 +445,11 @@ int main(int argc, char *args[]) {
         switch(c) {
             case 'r':
                 NUMBER_OF_ROOMS = atoi(optarg);
+                HAS_NUMBER_OF_ROOMS = 1;
                 break;
             case 'm':
                 NUMBER_OF_MONSTERS =  atoi(optarg);
+                HAS_NUMBER_OF_MONSTERS = 1;
                 if (NUMBER_OF_MONSTERS < 1) {
                     NUMBER_OF_MONSTERS = DEFAULT_NUMBER_OF_MONSTERS;
                     printf("Number of monsters cannot be less than 1\n");
@@ -173,6 +461,38 @@ int main(int argc, char *args[]) {
             case 'y':
                 player_y = atoi(optarg);
                 break;
+            case 's':
+                SEED = strtoull(optarg, NULL, 10);
+                HAS_SEED = 1;
+                break;
+            case 'i':
+                open_script_file(optarg);
+                IS_HEADLESS = 1;
+                break;
+            case 't':
+                MAX_TURNS = atoi(optarg);
+                break;
+            case 'b':
+                BATCH_SIZE = atoi(optarg);
+                break;
+            case 'o':
+                BATCH_DIRECTORY = optarg;
+                break;
+            case 'w':
+                BATCH_WORKERS = atoi(optarg);
+                break;
+            case 'e':
+                RECORD_FILE = optarg;
+                break;
+            case 'p':
+                REPLAY_FILE = optarg;
+                break;
+            case 'n':
+                STOP_AT_TURN = atoi(optarg);
+                break;
+            case 'l':
+                LEVEL_CACHE_KILOBYTES = atoi(optarg);
+                break;
             case 'h':
                 SHOW_HELP = 1;
                 break;
@@ -195,78 +515,196 @@ int main(int argc, char *args[]) {
     if (player_x == -1) {
         player_x = 0;
     }
+    if (!HAS_SEED) {
+        SEED = time(NULL);
+    }
+    if (DO_FAST_FORWARD) {
+        if (REPLAY_FILE == NULL) {
+            printf("--fast-forward needs a recording from --replay\n");
+            print_usage();
+            exit(1);
+        }
+        IS_HEADLESS = 1;
+    }
+    USE_AUTOPILOT = IS_HEADLESS && !SCRIPT_FILE;
     make_rlg_directory();
-    player.x = player_x;
-    player.y = player_y;
+    remove_stale_spill_files();
     update_number_of_rooms();
-    generate_new_board();
-    initscr();
-    noecho();
-    center_board_on_player();
-    move(ncurses_player_coord.y, ncurses_player_coord.x);
-    refresh();
-    while(NUMBER_OF_MONSTERS && PLAYER_IS_ALIVE && !DO_QUIT) {
+    USE_MAP_WORKERS = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+    // A game on screen spends most of its time waiting for keys, so the level
+    // worker has a core to itself even on a single core machine
+    USE_LEVEL_WORKER = !IS_HEADLESS || USE_MAP_WORKERS;
+    if (DO_BENCHMARK) {
+        run_benchmarks();
+        exit(0);
+    }
+    if (BATCH_SIZE > 0) {
+        if (BATCH_DIRECTORY == NULL) {
+            printf("--generate-batch needs an output directory from --out\n");
+            print_usage();
+            exit(1);
+        }
+        generate_batch();
+        exit(0);
+    }
+    Dungeon * dungeon = create_new_dungeon(NUMBER_OF_ROOMS, NUMBER_OF_MONSTERS);
+    seed_random_streams(dungeon, SEED);
+    dungeon->player.x = player_x;
+    dungeon->player.y = player_y;
+    int is_recovered = 0;
+    if (REPLAY_FILE) {
+        if (!start_journal_replay(dungeon, REPLAY_FILE)) {
+            exit(1);
+        }
+        is_recovered = 1;
+    }
+    else if (!DO_LOAD && !DO_COMPARE_DISTANCES && !RECORD_FILE && (DO_RECOVER || !IS_HEADLESS)) {
+        is_recovered = recover_from_journal(dungeon);
+    }
+    if (DO_LOAD) {
+        load_new_board(dungeon);
+    }
+    else if (!is_recovered) {
+        generate_new_board(dungeon);
+    }
+    if (DO_COMPARE_DISTANCES) {
+        compare_tunneling_distances(dungeon);
+        exit(0);
+    }
+    if (!IS_HEADLESS) {
+        initscr();
+        invalidate_board_view();
+        noecho();
+        center_board_on_player(dungeon);
         move(ncurses_player_coord.y, ncurses_player_coord.x);
-        Node min = extract_min(game_queue);
+        refresh();
+    }
+    if (!is_recovered) {
+        checkpoint_journal(dungeon);
+    }
+    int turns = 0;
+    int monster_moves = 0;
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    while(dungeon->number_of_monsters && dungeon->player_is_alive && !DO_QUIT) {
+        if (MAX_TURNS && turns >= MAX_TURNS) {
+            record_journal_stop();
+            break;
+        }
+        if (next_journal_stop()) {
+            break;
+        }
+        if (game_journal && journal_turns >= JOURNAL_CHECKPOINT_TURNS && !RECORD_FILE) {
+            checkpoint_journal(dungeon);
+        }
+        reset_arena(dungeon->turn_arena);
+        if (!IS_HEADLESS) {
+            move(ncurses_player_coord.y, ncurses_player_coord.x);
+        }
+        Node min = extract_min(dungeon->game_queue);
         int speed;
-        if (min.coord.x == player.x && min.coord.y == player.y) {
-            refresh();
+        if (min.coord.x == dungeon->player.x && min.coord.y == dungeon->player.y) {
+            int depth = dungeon->depth;
+            if (!IS_HEADLESS) {
+                refresh();
+            }
             add_message("It's your turn");
             speed = 10;
-            int success = 0;
-            while (!success) {
-                int ch = getch();
-                success = handle_user_input(ch);
-                while (!IS_CONTROL_MODE && !DO_QUIT) {
-                    success = 0;
-                    int ch = getch();
-                    handle_user_input_for_look_mode(ch);
-                    if (DO_QUIT) {
-                        success = 1;
+            prepare_next_levels(dungeon);
+            if (USE_AUTOPILOT) {
+                // Keyed games find the end of a replay in get_next_key; this
+                // is the same point for a game the autopilot played
+                if (journal_replay.records && journal_replay.offset == journal_replay.length) {
+                    finish_journal_replay();
+                }
+                if (DO_QUIT) {
+                    break;
+                }
+                move_player(dungeon);
+            }
+            else {
+                int success = 0;
+                while (!success) {
+                    int ch = get_next_key();
+                    success = handle_user_input(dungeon, ch);
+                    while (!IS_CONTROL_MODE && !DO_QUIT) {
+                        success = 0;
+                        int ch = get_next_key();
+                        handle_user_input_for_look_mode(dungeon, ch);
+                        if (DO_QUIT) {
+                            success = 1;
+                        }
                     }
                 }
             }
             if (DO_QUIT) {
                 break;
             }
-            center_board_on_player();
-            refresh();
-            min.coord.x = player.x;
-            min.coord.y = player.y;
-            set_non_tunneling_distance_to_player();
-            set_tunneling_distance_to_player();
+            turns ++;
+            record_journal_turn(dungeon);
+            if (turns == STOP_AT_TURN) {
+                stop_at_turn(turns);
+            }
+            if (!IS_HEADLESS) {
+                center_board_on_player(dungeon);
+                refresh();
+            }
+            mark_distance_maps_stale(dungeon);
+            if (dungeon->depth != depth) {
+                // change_level already gave the player a turn on the new level
+                continue;
+            }
+            min.coord.x = dungeon->player.x;
+            min.coord.y = dungeon->player.y;
         }
         else {
             add_message("The monsters are moving towards you...");
-            int monster_index = get_monster_index(min.coord);
+            int monster_index = get_monster_index(dungeon, min.coord);
             if (monster_index == -1) {
                 continue;
             }
-            move_monster_at_index(monster_index);
-            struct Monster monster = monsters[monster_index];
+            monster_index = move_monster_at_index(dungeon, monster_index);
+            monster_moves ++;
+            struct Monster monster = dungeon->monsters[monster_index];
             speed = monster.speed;
             min.coord.x = monster.x;
             min.coord.y = monster.y;
         }
-        insert_with_priority(game_queue, min.coord, (1000/speed) + min.priority);
+        insert_with_priority(dungeon->game_queue, min.coord, (1000/speed) + min.priority);
+    }
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    end_journal();
+
+    if (IS_HEADLESS) {
+        double seconds = (end_time.tv_sec - start_time.tv_sec) + ((end_time.tv_nsec - start_time.tv_nsec) / 1e9);
+        print_headless_report(dungeon, turns, monster_moves, seconds);
+        if (DO_SAVE) {
+            save_board(dungeon);
+        }
+        if (SCRIPT_FILE) {
+            fclose(SCRIPT_FILE);
+        }
+        free_dungeon(dungeon);
+        return 0;
     }
 
-    if (!PLAYER_IS_ALIVE) {
+    if (!dungeon->player_is_alive) {
         add_message("You lost. The monsters killed you (press any key to exit)");
     }
-    else if(!NUMBER_OF_MONSTERS) {
+    else if(!dungeon->number_of_monsters) {
         add_message("You won, killing all the monsters (press any key to exit)");
     }
 
     if (DO_SAVE) {
-        save_board();
+        save_board(dungeon);
     }
 
     if (!DO_QUIT) {
         getch();
     }
     endwin();
-
+    free_dungeon(dungeon);
 
     return 0;
 }
@@ -282,533 +720,1937 @@ void update_number_of_rooms() {
     }
 }
 
-void generate_new_board() {
-    initialize_board();
-    if (DO_LOAD) {
-        load_board();
-        DO_LOAD = 0;
+// The board is filled in by generate_new_board or load_new_board, and the
+// queues and level arena are made the first time they're needed.
+Dungeon * create_new_dungeon(int number_of_rooms, int number_of_monsters) {
+    Dungeon * dungeon = malloc(sizeof(Dungeon));
+    dungeon->rooms = NULL;
+    dungeon->monsters = NULL;
+    dungeon->player.x = 0;
+    dungeon->player.y = 0;
+    dungeon->game_queue = NULL;
+    dungeon->tunneling_bucket_queue = NULL;
+    dungeon->tunneling_heap_queue = NULL;
+    dungeon->distance_map_pool = NULL;
+    dungeon->level_cache = NULL;
+    dungeon->level_worker = NULL;
+    dungeon->next_levels = NULL;
+    dungeon->turn_arena = create_new_arena(TURN_ARENA_SIZE);
+    dungeon->level_arena = NULL;
+    dungeon->has_rock_rng = 0;
+    dungeon->player_is_alive = 1;
+    dungeon->depth = 0;
+    dungeon->tunneling_map_is_stale = 1;
+    dungeon->non_tunneling_map_is_stale = 1;
+    dungeon->number_of_rooms = number_of_rooms;
+    dungeon->rooms_per_level = number_of_rooms;
+    dungeon->number_of_monsters = number_of_monsters;
+    dungeon->monsters_per_level = number_of_monsters;
+    dungeon->number_of_placeable_areas = 0;
+    return dungeon;
+}
+
+void free_dungeon(Dungeon * dungeon) {
+    free_next_levels(dungeon);
+    if (dungeon->distance_map_pool) {
+        free_thread_pool(dungeon->distance_map_pool);
     }
-    else {
-        if (rooms) {
-            free(rooms);
+    if (dungeon->level_cache) {
+        free_level_cache(dungeon->level_cache);
+    }
+    if (dungeon->tunneling_bucket_queue) {
+        free_bucket_queue(dungeon->tunneling_bucket_queue);
+    }
+    if (dungeon->tunneling_heap_queue) {
+        free_queue(dungeon->tunneling_heap_queue);
+    }
+    if (dungeon->level_arena) {
+        free_arena(dungeon->level_arena);
+    }
+    free_arena(dungeon->turn_arena);
+    free(dungeon);
+}
+
+// Rooms, monsters and the game queue all live exactly as long as a level, so
+// they come out of one arena that is emptied whenever a new level starts.
+void reset_level_arena(Dungeon * dungeon) {
+    reserve_level_arena(dungeon, dungeon->number_of_monsters);
+    reset_arena(dungeon->level_arena);
+}
+
+// Replaces the level arena if it is too small for this many monsters, which
+// only happens when a saved game has more of them than the command line asked
+// for. Anything already allocated from the old arena is gone.
+void reserve_level_arena(Dungeon * dungeon, int number_of_monsters) {
+    size_t size = queue_size_in_bytes(number_of_monsters + 1);
+    size += sizeof(struct Monster) * number_of_monsters;
+    size += sizeof(struct Room) * MAX_ROOMS_PER_LEVEL;
+    size += 1024;
+    if (dungeon->level_arena && dungeon->level_arena->size >= size) {
+        return;
+    }
+    if (dungeon->level_arena) {
+        free_arena(dungeon->level_arena);
+    }
+    dungeon->level_arena = create_new_arena(size);
+}
+
+void generate_new_board(Dungeon * dungeon) {
+    dungeon->number_of_monsters = dungeon->monsters_per_level;
+    reset_level_arena(dungeon);
+    initialize_board(dungeon);
+    dungeon->rooms = arena_alloc(dungeon->level_arena, sizeof(struct Room) * dungeon->rooms_per_level);
+    dig_rooms(dungeon, dungeon->rooms_per_level);
+    dig_cooridors(dungeon);
+    populate_board(dungeon);
+}
+
+void load_new_board(Dungeon * dungeon) {
+    reset_level_arena(dungeon);
+    initialize_board(dungeon);
+    // A saved game already has its player, monsters and stairs
+    if (load_board(dungeon) == 0) {
+        populate_board(dungeon);
+    }
+}
+
+Level_Cache * get_level_cache(Dungeon * dungeon) {
+    if (!dungeon->level_cache) {
+        char * spill_prefix = malloc(strlen(RLG_DIRECTORY) + 32);
+        sprintf(spill_prefix, "%slevel-%d-", RLG_DIRECTORY, (int) getpid());
+        dungeon->level_cache = create_new_level_cache((size_t) LEVEL_CACHE_KILOBYTES * 1024, spill_prefix);
+        free(spill_prefix);
+    }
+    return dungeon->level_cache;
+}
+
+// A run's spilled levels are only removed when its level cache is freed, so a
+// run that was killed leaves them behind. Nothing reads them again, since a
+// recovered game gets its cached levels from the journal, so they are removed
+// at startup once the process that wrote them is gone.
+void remove_stale_spill_files() {
+    DIR * directory = opendir(RLG_DIRECTORY);
+    if (!directory) {
+        return;
+    }
+    struct dirent * entry;
+    while ((entry = readdir(directory))) {
+        int pid;
+        int depth;
+        int length = 0;
+        if (sscanf(entry->d_name, "level-%d-%d%n", &pid, &depth, &length) != 2 || entry->d_name[length] != '\0' || process_is_running(pid)) {
+            continue;
         }
-        rooms = malloc(sizeof(struct Room) * NUMBER_OF_ROOMS);
-        dig_rooms(NUMBER_OF_ROOMS);
-        dig_cooridors();
+        char * path = malloc(strlen(RLG_DIRECTORY) + strlen(entry->d_name) + 1);
+        strcpy(path, RLG_DIRECTORY);
+        strcat(path, entry->d_name);
+        unlink(path);
+        free(path);
     }
-    game_queue = create_new_queue(NUMBER_OF_MONSTERS + 1);
-    place_player();
-    set_placeable_areas();
-    set_non_tunneling_distance_to_player();
-    set_tunneling_distance_to_player();
-    generate_monsters();
-    generate_stairs();
+    closedir(directory);
 }
 
-struct Coordinate get_random_unoccupied_location_in_room(struct Room room) {
-    struct Available_Coords available_coords;
-    available_coords.length = 0;
-    available_coords.coords = malloc(sizeof(struct Coordinate) * (room.end_y - room.start_y) * (room.end_x - room.start_x));
+// The level being left goes in the level cache under its depth, and the level
+// at the new depth comes back out of it as it was left, with its tunnels and
+// surviving monsters. Depths never visited were usually built already by the
+// level worker while the player was on this level.
+void change_level(Dungeon * dungeon, int depth) {
+    Level_Cache * cache = get_level_cache(dungeon);
+    size_t size;
+    uint8_t * level = capture_level(dungeon, &size);
+    level_cache_put(cache, dungeon->depth, level, size);
+
+    uint8_t * cached = level_cache_take(cache, depth, &size);
+    int is_restored = cached && restore_level(dungeon, cached, size);
+    free(cached);
+    if (!is_restored) {
+        Next_Level * next = get_next_level(dungeon, depth);
+        restore_level(dungeon, next->level, next->size);
+    }
+    dungeon->depth = depth;
+    prepare_next_levels(dungeon);
+}
+
+// The random streams belong to the whole game rather than a level, so they
+// are left out and carry on from where they are when the level comes back.
+uint8_t * capture_level(Dungeon * dungeon, size_t * size) {
+    Queue * queue = dungeon->game_queue;
+    *size = sizeof(Level_Image) + (sizeof(Node) * queue->length);
+    *size += (sizeof(struct Monster) * dungeon->number_of_monsters) + (sizeof(struct Room) * dungeon->number_of_rooms);
+    Level_Image * image = malloc(*size);
+    memcpy(image->hardness, dungeon->board.hardness, sizeof(image->hardness));
+    memcpy(image->type, dungeon->board.type, sizeof(image->type));
+    image->rock_rng = dungeon->rock_rng;
+    image->has_rock_rng = dungeon->has_rock_rng;
+    image->player = dungeon->player;
+    image->number_of_rooms = dungeon->number_of_rooms;
+    image->number_of_monsters = dungeon->number_of_monsters;
+    image->queue_length = queue->length;
+    Node * nodes = (Node *) (image + 1);
+    struct Monster * monsters = (struct Monster *) (nodes + queue->length);
+    struct Room * rooms = (struct Room *) (monsters + dungeon->number_of_monsters);
+    memcpy(nodes, queue->nodes, sizeof(Node) * queue->length);
+    qsort(nodes, queue->length, sizeof(Node), compare_node_sequence);
+    memcpy(monsters, dungeon->monsters, sizeof(struct Monster) * dungeon->number_of_monsters);
+    memcpy(rooms, dungeon->rooms, sizeof(struct Room) * dungeon->number_of_rooms);
+    return (uint8_t *) image;
+}
+
+// The player's turn was taken out of the queue when the level was left, so it
+// is put back at the level's current time. Returns 0 if level is not a whole
+// Level_Image, which can only happen if its spill file was damaged.
+int restore_level(Dungeon * dungeon, uint8_t * level, size_t size) {
+    if (!unpack_level(dungeon, level, size)) {
+        return 0;
+    }
+    Queue * queue = dungeon->game_queue;
+    int now = queue->length ? queue->nodes[0].priority : 0;
+    insert_with_priority(queue, dungeon->player, now);
+    return 1;
+}
+
+// Copies a Level_Image into the dungeon as it is, without the player's turn
+int unpack_level(Dungeon * dungeon, uint8_t * level, size_t size) {
+    Level_Image * image = (Level_Image *) level;
+    if (size < sizeof(Level_Image)) {
+        return 0;
+    }
+    size_t expected_size = sizeof(Level_Image) + (sizeof(Node) * image->queue_length);
+    expected_size += (sizeof(struct Monster) * image->number_of_monsters) + (sizeof(struct Room) * image->number_of_rooms);
+    if (size != expected_size) {
+        return 0;
+    }
+    int queue_size = max(image->number_of_monsters + 1, image->queue_length + 1);
+    reserve_level_arena(dungeon, queue_size - 1);
+    reset_arena(dungeon->level_arena);
+
+    memcpy(dungeon->board.hardness, image->hardness, sizeof(image->hardness));
+    memcpy(dungeon->board.type, image->type, sizeof(image->type));
+    dungeon->rock_rng = image->rock_rng;
+    dungeon->has_rock_rng = image->has_rock_rng;
+    dungeon->player = image->player;
+    dungeon->number_of_rooms = image->number_of_rooms;
+    dungeon->number_of_monsters = image->number_of_monsters;
+    Node * nodes = (Node *) (image + 1);
+    struct Monster * monsters = (struct Monster *) (nodes + image->queue_length);
+    struct Room * rooms = (struct Room *) (monsters + image->number_of_monsters);
+
+    dungeon->rooms = arena_alloc(dungeon->level_arena, sizeof(struct Room) * image->number_of_rooms);
+    memcpy(dungeon->rooms, rooms, sizeof(struct Room) * image->number_of_rooms);
+    dungeon->monsters = arena_alloc(dungeon->level_arena, sizeof(struct Monster) * image->number_of_monsters);
+    memcpy(dungeon->monsters, monsters, sizeof(struct Monster) * image->number_of_monsters);
+    memset(dungeon->board.monster_at, 0, sizeof(dungeon->board.monster_at));
+    for (int i = 0; i < image->number_of_monsters; i++) {
+        dungeon->board.monster_at[monsters[i].y][monsters[i].x] = i + 1;
+    }
+
+    Queue * queue = create_new_queue_in(arena_alloc(dungeon->level_arena, queue_size_in_bytes(queue_size)), queue_size);
+    for (int i = 0; i < image->queue_length; i++) {
+        insert_with_priority(queue, nodes[i].coord, nodes[i].priority);
+    }
+    dungeon->game_queue = queue;
+    mark_distance_maps_stale(dungeon);
+    return 1;
+}
+
+// Waits for the level worker, then builds the level here if the worker was
+// not asked for it or built it from a game that has changed since.
+Next_Level * get_next_level(Dungeon * dungeon, int depth) {
+    if (dungeon->level_worker) {
+        thread_pool_wait(dungeon->level_worker);
+    }
+    Next_Level * next = get_next_level_slot(dungeon, depth);
+    if (!next_level_is_current(dungeon, next, depth)) {
+        set_next_level_source(dungeon, next, depth);
+        build_next_level(next);
+    }
+    return next;
+}
+
+// One slot for the level above and one for the level below
+Next_Level * get_next_level_slot(Dungeon * dungeon, int depth) {
+    if (!dungeon->next_levels) {
+        dungeon->next_levels = malloc(sizeof(Next_Level) * 2);
+        for (int i = 0; i < 2; i++) {
+            dungeon->next_levels[i].dungeon = create_new_dungeon(dungeon->rooms_per_level, dungeon->monsters_per_level);
+            dungeon->next_levels[i].level = NULL;
+        }
+    }
+    return &dungeon->next_levels[depth > dungeon->depth];
+}
+
+void set_next_level_source(Dungeon * dungeon, Next_Level * next, int depth) {
+    next->depth = depth;
+    next->rooms_per_level = dungeon->rooms_per_level;
+    next->monsters_per_level = dungeon->monsters_per_level;
+    next->terrain_rng = dungeon->terrain_rng;
+    next->rooms_rng = dungeon->rooms_rng;
+    next->monsters_rng = dungeon->monsters_rng;
+}
+
+int next_level_is_current(Dungeon * dungeon, Next_Level * next, int depth) {
+    return next->level && next->depth == depth &&
+        next->rooms_per_level == dungeon->rooms_per_level &&
+        next->monsters_per_level == dungeon->monsters_per_level &&
+        !memcmp(&next->terrain_rng, &dungeon->terrain_rng, sizeof(Rng)) &&
+        !memcmp(&next->rooms_rng, &dungeon->rooms_rng, sizeof(Rng)) &&
+        !memcmp(&next->monsters_rng, &dungeon->monsters_rng, sizeof(Rng));
+}
+
+// New levels are built from streams split off the game's by depth, and the
+// game's streams are left alone. The levels above and below can then both be
+// built ahead of time and still differ, and a level comes out the same
+// whether the worker built it or it was built when the stairs were taken.
+void build_next_level(Next_Level * next) {
+    Dungeon * level = next->dungeon;
+    Rng terrain_rng = next->terrain_rng;
+    Rng rooms_rng = next->rooms_rng;
+    Rng monsters_rng = next->monsters_rng;
+    level->terrain_rng = rng_split(&terrain_rng, next->depth);
+    level->rooms_rng = rng_split(&rooms_rng, next->depth);
+    level->monsters_rng = rng_split(&monsters_rng, next->depth);
+    level->rooms_per_level = next->rooms_per_level;
+    level->monsters_per_level = next->monsters_per_level;
+    level->player.x = 0;
+    level->player.y = 0;
+    reset_arena(level->turn_arena);
+    generate_new_board(level);
+    // restore_level gives the player a turn when the level is entered
+    extract_min(level->game_queue);
+    free(next->level);
+    next->level = capture_level(level, &next->size);
+}
+
+void build_next_level_task(void * data) {
+    build_next_level(data);
+}
+
+// Hands the level worker the depths above and below that are neither cached
+// nor already built for the game as it is now. Called every turn, so it never
+// waits: while the worker is busy the slots are its own, and they are looked
+// at again on a later turn or joined by get_next_level when the stairs are
+// taken.
+void prepare_next_levels(Dungeon * dungeon) {
+    if (!USE_LEVEL_WORKER) {
+        return;
+    }
+    if (!dungeon->level_worker) {
+        dungeon->level_worker = create_new_thread_pool(1, 2);
+    }
+    if (!thread_pool_is_idle(dungeon->level_worker)) {
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        int depth = dungeon->depth + (i ? 1 : -1);
+        if (dungeon->level_cache && level_cache_has(dungeon->level_cache, depth)) {
+            continue;
+        }
+        Next_Level * next = get_next_level_slot(dungeon, depth);
+        if (!next_level_is_current(dungeon, next, depth)) {
+            set_next_level_source(dungeon, next, depth);
+            thread_pool_submit(dungeon->level_worker, build_next_level_task, next);
+        }
+    }
+}
+
+// The worker goes first, since it may still be building into the slots
+void free_next_levels(Dungeon * dungeon) {
+    if (dungeon->level_worker) {
+        free_thread_pool(dungeon->level_worker);
+    }
+    if (dungeon->next_levels) {
+        for (int i = 0; i < 2; i++) {
+            free(dungeon->next_levels[i].level);
+            free_dungeon(dungeon->next_levels[i].dungeon);
+        }
+        free(dungeon->next_levels);
+    }
+}
+
+// Puts the player, monsters and stairs on a board whose terrain is done
+void populate_board(Dungeon * dungeon) {
+    dungeon->game_queue = create_new_queue_in(arena_alloc(dungeon->level_arena, queue_size_in_bytes(dungeon->number_of_monsters + 1)), dungeon->number_of_monsters + 1);
+    place_player(dungeon);
+    set_placeable_areas(dungeon);
+    mark_distance_maps_stale(dungeon);
+    generate_monsters(dungeon);
+    generate_stairs(dungeon);
+}
+
+int is_unoccupied_room_cell(Dungeon * dungeon, int x, int y) {
+    return y != dungeon->player.y && x != dungeon->player.x && !dungeon->board.monster_at[y][x];
+}
+
+// Counts the free cells and then walks to the chosen one, rather than listing
+// them, so a level with hundreds of rooms doesn't fill the turn arena.
+struct Coordinate get_random_unoccupied_location_in_room(Dungeon * dungeon, struct Room room) {
+    int number_of_cells = 0;
     for (int y = room.start_y; y < room.end_y; y++) {
         for (int x = room.start_x; x < room.end_x; x++) {
-            Board_Cell cell =  board[y][x];
-            if (y != player.y && x != player.x && !cell.has_monster) {
-                struct Coordinate coord;
-                coord.y = y;
+            number_of_cells += is_unoccupied_room_cell(dungeon, x, y);
+        }
+    }
+    int index = rng_int(&dungeon->rooms_rng, 0, number_of_cells - 1);
+    struct Coordinate coord;
+    coord.x = room.start_x;
+    coord.y = room.start_y;
+    for (int y = room.start_y; y < room.end_y; y++) {
+        for (int x = room.start_x; x < room.end_x; x++) {
+            if (is_unoccupied_room_cell(dungeon, x, y) && index-- == 0) {
                 coord.x = x;
-                available_coords.coords[available_coords.length]= coord;
-                available_coords.length ++;
+                coord.y = y;
+                return coord;
             }
         }
     }
-    int index = random_int(0, available_coords.length, room.start_x);
-    return available_coords.coords[index];
+    return coord;
 }
 
-void generate_stairs() {
-    int number_of_stairs_up = NUMBER_OF_ROOMS / 2;
+void generate_stairs(Dungeon * dungeon) {
+    int number_of_stairs_up = dungeon->number_of_rooms / 2;
     for (int i = 0; i < number_of_stairs_up; i++) {
-        struct Room room = rooms[i];
-        struct Coordinate coord = get_random_unoccupied_location_in_room(room);
-        board[coord.y][coord.x].type = TYPE_UPSTAIR;
+        struct Room room = dungeon->rooms[i];
+        struct Coordinate coord = get_random_unoccupied_location_in_room(dungeon, room);
+        dungeon->board.type[coord.y][coord.x] = TYPE_UPSTAIR;
     }
-    for (int i = number_of_stairs_up; i < NUMBER_OF_ROOMS; i++) {
-        struct Room room = rooms[i];
-        struct Coordinate coord = get_random_unoccupied_location_in_room(room);
-        board[coord.y][coord.x].type = TYPE_DOWNSTAIR;
+    for (int i = number_of_stairs_up; i < dungeon->number_of_rooms; i++) {
+        struct Room room = dungeon->rooms[i];
+        struct Coordinate coord = get_random_unoccupied_location_in_room(dungeon, room);
+        dungeon->board.type[coord.y][coord.x] = TYPE_DOWNSTAIR;
     }
 }
 
 void make_rlg_directory() {
     char * home = getenv("HOME");
     char dir[] = "/.rlg327/";
-    RLG_DIRECTORY = malloc(strlen(home) + strlen(dir));
-    strcat(RLG_DIRECTORY, home);
+    RLG_DIRECTORY = malloc(strlen(home) + strlen(dir) + 1);
+    strcpy(RLG_DIRECTORY, home);
     strcat(RLG_DIRECTORY, dir);
     mkdir(RLG_DIRECTORY, 0777);
 }
 
-void save_board() {
+void save_board(Dungeon * dungeon) {
     char filename[] = "dungeon";
-    char * filepath = malloc(strlen(filename) + strlen(RLG_DIRECTORY));
-    strcat(filepath, RLG_DIRECTORY);
+    char * filepath = malloc(strlen(filename) + strlen(RLG_DIRECTORY) + 1);
+    strcpy(filepath, RLG_DIRECTORY);
     strcat(filepath, filename);
     printf("Saving file to: %s\n", filepath);
-    FILE * fp = fopen(filepath, "wb+");
-    if (fp == NULL) {
+    save_game_to(dungeon, filepath);
+    free(filepath);
+}
+
+// The hardness plane is laid out exactly like the file's hardness section,
+// so the header, the plane and the rooms go out in one gathered write.
+int save_board_to(Dungeon * dungeon, char * filepath) {
+    int fd = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) {
         printf("Cannot save file\n");
-        return;
+        return 0;
     }
-    char * file_marker = "RLG327-S2017";
+    uint8_t header[SAVE_HEADER_SIZE];
     uint32_t version = htonl(0);
-    uint32_t file_size = htonl(16820 + (NUMBER_OF_ROOMS * 4));
+    uint32_t file_size = SAVE_HEADER_SIZE + sizeof(dungeon->board.hardness) + (dungeon->number_of_rooms * 4);
+    uint32_t network_file_size = htonl(file_size);
+    memcpy(header, SAVE_FILE_MARKER, SAVE_FILE_MARKER_SIZE);
+    memcpy(header + SAVE_FILE_MARKER_SIZE, &version, 4);
+    memcpy(header + SAVE_FILE_MARKER_SIZE + 4, &network_file_size, 4);
+
+    uint8_t rooms[MAX_ROOMS_PER_LEVEL * 4];
+    for (int i = 0; i < dungeon->number_of_rooms; i++) {
+        struct Room room = dungeon->rooms[i];
+        rooms[(i * 4)] = room.start_x;
+        rooms[(i * 4) + 1] = room.start_y;
+        rooms[(i * 4) + 2] = room.end_x - room.start_x + 1;
+        rooms[(i * 4) + 3] = room.end_y - room.start_y + 1;
+    }
+
+    struct iovec parts[3];
+    parts[0].iov_base = header;
+    parts[0].iov_len = SAVE_HEADER_SIZE;
+    parts[1].iov_base = dungeon->board.hardness;
+    parts[1].iov_len = sizeof(dungeon->board.hardness);
+    parts[2].iov_base = rooms;
+    parts[2].iov_len = dungeon->number_of_rooms * 4;
+    ssize_t written = writev(fd, parts, 3);
+    close(fd);
+    if (written != file_size) {
+        printf("Cannot save file\n");
+        return 0;
+    }
+    return 1;
+}
 
-    fwrite(file_marker, 1, strlen(file_marker), fp);
-    fwrite(&version, 1, 4, fp);
-    fwrite(&file_size, 1, 4, fp);
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            uint8_t num = board[y][x].hardness;
-            fwrite(&num, 1, 1, fp);
+uint8_t * put_u16(uint8_t * out, uint16_t value) {
+    out[0] = value >> 8;
+    out[1] = value;
+    return out + 2;
+}
+
+uint8_t * put_u32(uint8_t * out, uint32_t value) {
+    out = put_u16(out, value >> 16);
+    return put_u16(out, value);
+}
+
+uint8_t * put_u64(uint8_t * out, uint64_t value) {
+    out = put_u32(out, value >> 32);
+    return put_u32(out, value);
+}
+
+uint8_t * put_rng(uint8_t * out, Rng * rng) {
+    out = put_u64(out, rng->state);
+    return put_u64(out, rng->increment);
+}
+
+// Writes a run-length encoded plane after its encoded length
+uint8_t * put_plane(uint8_t * out, uint8_t * plane) {
+    size_t length = run_length_encode(plane, HEIGHT * WIDTH, out + 4);
+    put_u32(out, length);
+    return out + 4 + length;
+}
+
+// Hardness is mostly the rock the level started with, so when the stream that
+// made that rock is known only the cells that differ from it are kept:
+// SAVE_ROCK_UNCHANGED, SAVE_ROCK_DUG for a cell dug down to nothing, or the
+// hardness a monster has worn it down to.
+uint8_t * put_hardness(uint8_t * out, Dungeon * dungeon) {
+    uint8_t * hardness = &dungeon->board.hardness[0][0];
+    if (dungeon->has_rock_rng) {
+        uint8_t (*changes)[WIDTH] = malloc(sizeof(dungeon->board.hardness));
+        uint8_t * rock = &changes[0][0];
+        Rng rng = dungeon->rock_rng;
+        generate_rock(&rng, changes);
+        int is_encodable = 1;
+        for (int i = 0; i < HEIGHT * WIDTH; i++) {
+            if (hardness[i] == rock[i]) {
+                rock[i] = SAVE_ROCK_UNCHANGED;
+            }
+            else if (hardness[i] == 0) {
+                rock[i] = SAVE_ROCK_DUG;
+            }
+            else if (hardness[i] == SAVE_ROCK_DUG) {
+                is_encodable = 0;
+                break;
+            }
+            else {
+                rock[i] = hardness[i];
+            }
         }
+        if (is_encodable) {
+            *out++ = 1;
+            out = put_rng(out, &dungeon->rock_rng);
+            out = put_plane(out, rock);
+            free(changes);
+            return out;
+        }
+        free(changes);
     }
+    *out++ = 0;
+    return put_plane(out, hardness);
+}
+
+int compare_node_sequence(const void * node1, const void * node2) {
+    unsigned int sequence1 = ((const Node *) node1)->sequence;
+    unsigned int sequence2 = ((const Node *) node2)->sequence;
+    return (sequence1 > sequence2) - (sequence1 < sequence2);
+}
 
-    for (int i = 0; i < NUMBER_OF_ROOMS; i++) {
-        struct Room room = rooms[i];
-        uint8_t height = room.end_y - room.start_y + 1;
-        uint8_t width = room.end_x - room.start_x + 1;
-        fwrite(&room.start_x, 1, 1, fp);
-        fwrite(&room.start_y, 1, 1, fp);
-        fwrite(&(width), 1, 1, fp);
-        fwrite(&(height), 1, 1, fp);
+// Version 1 keeps the whole game, not just the terrain: the player, rooms,
+// monsters, the turn queue, the random streams and every cell's type, so a
+// loaded game carries on from the exact turn it was saved on. Both planes are
+// run-length encoded after put_hardness has reduced hardness to its changes,
+// which usually leaves a few hundred bytes. Version 2 adds the depth, the
+// numbers of rooms and monsters new levels ask for and the levels in the
+// level cache, each written the same way as the current one.
+int save_game_to(Dungeon * dungeon, char * filepath) {
+    uint32_t file_size;
+    uint8_t * buffer = encode_game(dungeon, 0, &file_size);
+    int fd = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    ssize_t written = -1;
+    if (fd != -1) {
+        written = write(fd, buffer, file_size);
+        close(fd);
+    }
+    free(buffer);
+    if (written != file_size) {
+        printf("Cannot save file\n");
+        return 0;
     }
-    fclose(fp);
+    return 1;
 }
 
-void load_board() {
+// Returns a malloced buffer holding offset bytes for the caller to fill in,
+// followed by the version 2 file for the game, which is size bytes long.
+uint8_t * encode_game(Dungeon * dungeon, size_t offset, uint32_t * size) {
+    size_t capacity = offset + SAVE_HEADER_SIZE + 3 + (4 * 16) + get_encoded_level_size_bound(dungeon) + 4 + 2 + 2 + 2;
+    uint8_t * buffer = malloc(capacity);
+
+    uint8_t * out = buffer + offset + SAVE_HEADER_SIZE;
+    *out++ = dungeon->player.x;
+    *out++ = dungeon->player.y;
+    *out++ = dungeon->player_is_alive;
+    out = put_rng(out, &dungeon->terrain_rng);
+    out = put_rng(out, &dungeon->rooms_rng);
+    out = put_rng(out, &dungeon->monsters_rng);
+    out = put_rng(out, &dungeon->ai_rng);
+    out = put_level(out, dungeon);
+
+    out = put_u32(out, dungeon->depth);
+    out = put_u16(out, dungeon->rooms_per_level);
+    out = put_u16(out, dungeon->monsters_per_level);
+    if (dungeon->level_cache) {
+        buffer = put_cached_levels(buffer, &out, dungeon->level_cache);
+    }
+    else {
+        out = put_u16(out, 0);
+    }
+
+    uint8_t * file = buffer + offset;
+    *size = out - file;
+    memcpy(file, SAVE_FILE_MARKER, SAVE_FILE_MARKER_SIZE);
+    put_u32(file + SAVE_FILE_MARKER_SIZE, 2);
+    put_u32(file + SAVE_FILE_MARKER_SIZE + 4, *size);
+    return buffer;
+}
+
+size_t get_encoded_level_size_bound(Dungeon * dungeon) {
+    size_t size = 2 + (dungeon->number_of_rooms * SAVE_ROOM_SIZE);
+    size += 2 + (dungeon->number_of_monsters * SAVE_MONSTER_SIZE);
+    size += 2 + (dungeon->game_queue->length * SAVE_QUEUE_ENTRY_SIZE);
+    size += 1 + 16 + (2 * (4 + run_length_encoded_size_bound(HEIGHT * WIDTH)));
+    return size;
+}
+
+// Writes the rooms, monsters, turn queue and both planes of a level
+uint8_t * put_level(uint8_t * out, Dungeon * dungeon) {
+    Queue * queue = dungeon->game_queue;
+    out = put_u16(out, dungeon->number_of_rooms);
+    for (int i = 0; i < dungeon->number_of_rooms; i++) {
+        struct Room room = dungeon->rooms[i];
+        *out++ = room.start_x;
+        *out++ = room.start_y;
+        *out++ = room.end_x - room.start_x + 1;
+        *out++ = room.end_y - room.start_y + 1;
+    }
+
+    out = put_u16(out, dungeon->number_of_monsters);
+    for (int i = 0; i < dungeon->number_of_monsters; i++) {
+        struct Monster monster = dungeon->monsters[i];
+        *out++ = monster.x;
+        *out++ = monster.y;
+        *out++ = monster.decimal_type;
+        *out++ = monster.speed;
+        *out++ = monster.last_known_player_location.x;
+        *out++ = monster.last_known_player_location.y;
+    }
+
+    // In insertion order, so inserting them again on load breaks ties between
+    // equal priorities the same way the saved queue would have
+    Node * nodes = malloc(sizeof(Node) * (queue->length + 1));
+    memcpy(nodes, queue->nodes, sizeof(Node) * queue->length);
+    qsort(nodes, queue->length, sizeof(Node), compare_node_sequence);
+    out = put_u16(out, queue->length);
+    for (int i = 0; i < queue->length; i++) {
+        *out++ = nodes[i].coord.x;
+        *out++ = nodes[i].coord.y;
+        out = put_u32(out, nodes[i].priority);
+    }
+    free(nodes);
+
+    out = put_hardness(out, dungeon);
+    return put_plane(out, &dungeon->board.type[0][0]);
+}
+
+// Writes how many levels are cached and then each one, oldest first, as its
+// depth, where the player left it and put_level's fields. Their queues do not
+// have the player's turn, which is only given back when the level is entered.
+// Grows buffer to fit as it goes, so the new buffer is returned and *out moved
+// along in it. A level whose spill file is damaged is left out.
+uint8_t * put_cached_levels(uint8_t * buffer, uint8_t ** out, Level_Cache * cache) {
+    size_t count_offset = *out - buffer;
+    size_t used = count_offset + 2;
+    int number_of_levels = 0;
+    Dungeon * level = create_new_dungeon(0, 0);
+    for (Cached_Level * cached = cache->oldest; cached; cached = cached->newer) {
+        size_t size;
+        uint8_t * bytes = level_cache_copy(cache, cached->depth, &size);
+        int is_unpacked = bytes && unpack_level(level, bytes, size);
+        free(bytes);
+        if (!is_unpacked) {
+            continue;
+        }
+        buffer = realloc(buffer, used + 4 + 2 + get_encoded_level_size_bound(level));
+        uint8_t * level_out = put_u32(buffer + used, cached->depth);
+        *level_out++ = level->player.x;
+        *level_out++ = level->player.y;
+        level_out = put_level(level_out, level);
+        used = level_out - buffer;
+        number_of_levels ++;
+    }
+    free_dungeon(level);
+    put_u16(buffer + count_offset, number_of_levels);
+    *out = buffer + used;
+    return buffer;
+}
+
+int load_board(Dungeon * dungeon) {
     char filename[] = "dungeon";
-    char * filepath = malloc(strlen(filename) + strlen(RLG_DIRECTORY));
-    strcat(filepath, RLG_DIRECTORY);
+    char * filepath = malloc(strlen(filename) + strlen(RLG_DIRECTORY) + 1);
+    strcpy(filepath, RLG_DIRECTORY);
     strcat(filepath, filename);
     printf("Loading dungeon: %s\n", filepath);
-    FILE *fp = fopen(filepath, "r");
-    if (fp == NULL) {
+    int version = load_board_from(dungeon, filepath);
+    free(filepath);
+    return version;
+}
+
+// Maps the whole file and checks the header against its real size. A version 0
+// file only has terrain, so its hardness section is copied straight into the
+// hardness plane and the caller still has to populate the level; a version 1
+// or 2 file restores the whole game. Returns the version that was loaded.
+int load_board_from(Dungeon * dungeon, char * filepath) {
+    int fd = open(filepath, O_RDONLY);
+    struct stat file_stat;
+    if (fd == -1 || fstat(fd, &file_stat) == -1) {
         printf("Cannot load '%s'\n", filepath);
         exit(1);
     }
-    char title[13]; // one extra index for the null value at the end
+    if (file_stat.st_size < SAVE_HEADER_SIZE) {
+        printf("'%s' is too small to be a dungeon: %lld bytes\n", filepath, (long long) file_stat.st_size);
+        exit(1);
+    }
+    uint8_t * file = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        printf("Cannot load '%s'\n", filepath);
+        exit(1);
+    }
+    int version = load_board_bytes(dungeon, file, file_stat.st_size, filepath);
+    munmap(file, file_stat.st_size);
+    return version;
+}
+
+// Loads a whole dungeon file of size bytes, at least a header's worth, that
+// is already in memory. filepath is only used in error messages.
+int load_board_bytes(Dungeon * dungeon, uint8_t * file, size_t size, char * filepath) {
+    size_t hardness_size = sizeof(dungeon->board.hardness);
+    char title[SAVE_FILE_MARKER_SIZE + 1];
     uint32_t version;
     uint32_t file_size;
+    memcpy(title, file, SAVE_FILE_MARKER_SIZE);
+    title[SAVE_FILE_MARKER_SIZE] = '\0';
+    memcpy(&version, file + SAVE_FILE_MARKER_SIZE, 4);
+    version = ntohl(version);
+    memcpy(&file_size, file + SAVE_FILE_MARKER_SIZE + 4, 4);
+    file_size = ntohl(file_size);
 
+    if (!DO_BENCHMARK) {
+        printf("File Marker: %s :: Version: %d :: File Size: %d bytes\n", title, version, file_size);
+    }
+    if (strcmp(title, SAVE_FILE_MARKER) != 0 || version > 2) {
+        printf("'%s' is not a version 0, 1 or 2 RLG327 dungeon\n", filepath);
+        exit(1);
+    }
+    if (file_size != size) {
+        printf("'%s' says it is %u bytes but is %zu bytes\n", filepath, file_size, size);
+        exit(1);
+    }
+    if (version >= 1) {
+        if (!load_game_state(dungeon, file + SAVE_HEADER_SIZE, file_size - SAVE_HEADER_SIZE, version)) {
+            printf("'%s' is not a valid saved game\n", filepath);
+            exit(1);
+        }
+        return version;
+    }
+    if (file_size < SAVE_HEADER_SIZE + hardness_size || (file_size - SAVE_HEADER_SIZE - hardness_size) % 4 != 0) {
+        printf("'%s' is %u bytes, which does not fit a version 0 dungeon\n", filepath, file_size);
+        exit(1);
+    }
+    dungeon->number_of_rooms = (file_size - SAVE_HEADER_SIZE - hardness_size) / 4;
+    if (dungeon->number_of_rooms > MAX_ROOMS_PER_LEVEL) {
+        printf("Cannot load more than %d rooms\n", MAX_ROOMS_PER_LEVEL);
+        exit(1);
+    }
 
-    // Get title
-    fread(title, 1, 12, fp);
+    uint8_t * hardness = &dungeon->board.hardness[0][0];
+    uint8_t * types = &dungeon->board.type[0][0];
+    memcpy(hardness, file + SAVE_HEADER_SIZE, hardness_size);
+    dungeon->has_rock_rng = 0;
+    for (int i = 0; i < HEIGHT * WIDTH; i++) {
+        types[i] = hardness[i] ? TYPE_ROCK : TYPE_CORRIDOR;
+    }
+    memset(dungeon->board.monster_at, 0, sizeof(dungeon->board.monster_at));
 
-    // Get version
-    fread(&version, 4, 1, fp);
-    version = ntohl(version);
+    uint8_t * rooms = file + SAVE_HEADER_SIZE + hardness_size;
+    dungeon->rooms = arena_alloc(dungeon->level_arena, sizeof(struct Room) * dungeon->number_of_rooms);
+    for (int i = 0; i < dungeon->number_of_rooms; i++) {
+        struct Room room;
+        room.start_x = rooms[(i * 4)];
+        room.start_y = rooms[(i * 4) + 1];
+        room.end_x = room.start_x + rooms[(i * 4) + 2] - 1;
+        room.end_y = room.start_y + rooms[(i * 4) + 3] - 1;
+        dungeon->rooms[i] = room;
+    }
+    add_rooms_to_board(dungeon);
+    return version;
+}
 
-    // Get file size
-    fread(&file_size, 4, 1, fp);
-    file_size = ntohl(file_size);
+uint8_t * read_save_bytes(Save_Reader * reader, size_t length) {
+    if (reader->overran || length > reader->length - reader->offset) {
+        reader->overran = 1;
+        return NULL;
+    }
+    uint8_t * bytes = reader->bytes + reader->offset;
+    reader->offset += length;
+    return bytes;
+}
+
+uint8_t read_save_u8(Save_Reader * reader) {
+    uint8_t * bytes = read_save_bytes(reader, 1);
+    return bytes ? bytes[0] : 0;
+}
+
+uint16_t read_save_u16(Save_Reader * reader) {
+    uint8_t * bytes = read_save_bytes(reader, 2);
+    return bytes ? (bytes[0] << 8) | bytes[1] : 0;
+}
+
+uint32_t read_save_u32(Save_Reader * reader) {
+    uint32_t high = read_save_u16(reader);
+    return (high << 16) | read_save_u16(reader);
+}
+
+uint64_t read_save_u64(Save_Reader * reader) {
+    uint64_t high = read_save_u32(reader);
+    return (high << 32) | read_save_u32(reader);
+}
+
+void read_save_rng(Save_Reader * reader, Rng * rng) {
+    rng->state = read_save_u64(reader);
+    rng->increment = read_save_u64(reader);
+}
+
+int read_save_plane(Save_Reader * reader, uint8_t * plane) {
+    uint32_t length = read_save_u32(reader);
+    uint8_t * encoded = read_save_bytes(reader, length);
+    return encoded && run_length_decode(encoded, length, plane, HEIGHT * WIDTH);
+}
+
+// Undoes put_hardness
+int read_save_hardness(Save_Reader * reader, Dungeon * dungeon) {
+    uint8_t * hardness = &dungeon->board.hardness[0][0];
+    dungeon->has_rock_rng = read_save_u8(reader);
+    if (!dungeon->has_rock_rng) {
+        return read_save_plane(reader, hardness);
+    }
+    read_save_rng(reader, &dungeon->rock_rng);
+    uint8_t * changes = malloc(HEIGHT * WIDTH);
+    int is_valid = dungeon->has_rock_rng == 1 && read_save_plane(reader, changes);
+    Rng rng = dungeon->rock_rng;
+    generate_rock(&rng, dungeon->board.hardness);
+    for (int i = 0; i < HEIGHT * WIDTH && is_valid; i++) {
+        if (changes[i] == SAVE_ROCK_DUG) {
+            hardness[i] = 0;
+        }
+        else if (changes[i] != SAVE_ROCK_UNCHANGED) {
+            hardness[i] = changes[i];
+        }
+    }
+    free(changes);
+    return is_valid;
+}
+
+int coordinate_is_on_board(uint8_t x, uint8_t y) {
+    return x < WIDTH && y < HEIGHT;
+}
+
+// Restores the body of a version 1 or 2 file written by save_game_to. A
+// version 1 game is taken to be on the first level with nothing cached, and
+// its new levels ask for the numbers of rooms and monsters the dungeon was
+// created with.
+// Returns 0 if it is truncated or describes a game that cannot exist.
+int load_game_state(Dungeon * dungeon, uint8_t * bytes, size_t length, int version) {
+    Save_Reader reader;
+    reader.bytes = bytes;
+    reader.length = length;
+    reader.offset = 0;
+    reader.overran = 0;
+
+    dungeon->player.x = read_save_u8(&reader);
+    dungeon->player.y = read_save_u8(&reader);
+    dungeon->player_is_alive = read_save_u8(&reader);
+    read_save_rng(&reader, &dungeon->terrain_rng);
+    read_save_rng(&reader, &dungeon->rooms_rng);
+    read_save_rng(&reader, &dungeon->monsters_rng);
+    read_save_rng(&reader, &dungeon->ai_rng);
+    if (!coordinate_is_on_board(dungeon->player.x, dungeon->player.y) || !read_save_level(&reader, dungeon)) {
+        return 0;
+    }
+    set_placeable_areas(dungeon);
+    mark_distance_maps_stale(dungeon);
+
+    if (dungeon->level_cache) {
+        free_level_cache(dungeon->level_cache);
+        dungeon->level_cache = NULL;
+    }
+    dungeon->depth = 0;
+    if (version >= 2) {
+        dungeon->depth = (int32_t) read_save_u32(&reader);
+        dungeon->rooms_per_level = read_save_u16(&reader);
+        dungeon->monsters_per_level = read_save_u16(&reader);
+        if (dungeon->rooms_per_level > MAX_ROOMS_PER_LEVEL || !dungeon->monsters_per_level || !read_save_cached_levels(&reader, dungeon)) {
+            return 0;
+        }
+    }
+    return !reader.overran && reader.offset == length;
+}
 
-    printf("File Marker: %s :: Version: %d :: File Size: %d bytes\n", title, version, file_size);
+// Undoes put_level, building the level in the dungeon's level arena
+int read_save_level(Save_Reader * reader, Dungeon * dungeon) {
+    int number_of_rooms = read_save_u16(reader);
+    uint8_t * rooms = read_save_bytes(reader, number_of_rooms * SAVE_ROOM_SIZE);
+    int number_of_monsters = read_save_u16(reader);
+    uint8_t * monsters = read_save_bytes(reader, number_of_monsters * SAVE_MONSTER_SIZE);
+    int queue_length = read_save_u16(reader);
+    uint8_t * queued = read_save_bytes(reader, queue_length * SAVE_QUEUE_ENTRY_SIZE);
+    if (!read_save_hardness(reader, dungeon) || !read_save_plane(reader, &dungeon->board.type[0][0])) {
+        return 0;
+    }
+    if (reader->overran || number_of_rooms > MAX_ROOMS_PER_LEVEL) {
+        return 0;
+    }
+    uint8_t * types = &dungeon->board.type[0][0];
+    for (int i = 0; i < HEIGHT * WIDTH; i++) {
+        if (types[i] >= NUMBER_OF_CELL_TYPES) {
+            return 0;
+        }
+    }
 
-    uint8_t num;
-    int x = 0;
-    int y = 0;
-    for (int i = 0; i < 16800; i++) {
-        fread(&num, 1, 1, fp);
-        Board_Cell cell;
-        cell.hardness = num;
-        cell.has_monster = 0;
-        cell.has_player = 0;
-        if (num == 0) {
-            cell.type = TYPE_CORRIDOR;
+    int queue_size = max(number_of_monsters + 1, queue_length + 1);
+    reserve_level_arena(dungeon, queue_size - 1);
+    reset_arena(dungeon->level_arena);
+
+    dungeon->number_of_rooms = number_of_rooms;
+    dungeon->rooms = arena_alloc(dungeon->level_arena, sizeof(struct Room) * number_of_rooms);
+    for (int i = 0; i < number_of_rooms; i++) {
+        uint8_t * fields = rooms + (i * SAVE_ROOM_SIZE);
+        struct Room room;
+        room.start_x = fields[0];
+        room.start_y = fields[1];
+        room.end_x = room.start_x + fields[2] - 1;
+        room.end_y = room.start_y + fields[3] - 1;
+        dungeon->rooms[i] = room;
+    }
+
+    memset(dungeon->board.monster_at, 0, sizeof(dungeon->board.monster_at));
+    dungeon->number_of_monsters = number_of_monsters;
+    dungeon->monsters = arena_alloc(dungeon->level_arena, sizeof(struct Monster) * number_of_monsters);
+    for (int i = 0; i < number_of_monsters; i++) {
+        uint8_t * fields = monsters + (i * SAVE_MONSTER_SIZE);
+        struct Monster monster;
+        monster.x = fields[0];
+        monster.y = fields[1];
+        monster.decimal_type = fields[2];
+        monster.speed = fields[3];
+        monster.last_known_player_location.x = fields[4];
+        monster.last_known_player_location.y = fields[5];
+        if (!coordinate_is_on_board(monster.x, monster.y) || monster.decimal_type >= strlen(MONSTER_GLYPHS) || monster.speed == 0) {
+            return 0;
+        }
+        dungeon->monsters[i] = monster;
+        dungeon->board.monster_at[monster.y][monster.x] = i + 1;
+    }
+
+    dungeon->game_queue = create_new_queue_in(arena_alloc(dungeon->level_arena, queue_size_in_bytes(queue_size)), queue_size);
+    for (int i = 0; i < queue_length; i++) {
+        uint8_t * fields = queued + (i * SAVE_QUEUE_ENTRY_SIZE);
+        struct Coordinate coord;
+        coord.x = fields[0];
+        coord.y = fields[1];
+        uint32_t priority = ((uint32_t) fields[2] << 24) | (fields[3] << 16) | (fields[4] << 8) | fields[5];
+        if (!coordinate_is_on_board(coord.x, coord.y) || priority > INT_MAX) {
+            return 0;
+        }
+        if (!insert_with_priority(dungeon->game_queue, coord, priority)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Undoes put_cached_levels. Each level is read into a dungeon of its own and
+// goes into a new level cache the same way it would on the stairs.
+int read_save_cached_levels(Save_Reader * reader, Dungeon * dungeon) {
+    int number_of_levels = read_save_u16(reader);
+    if (number_of_levels == 0) {
+        return !reader->overran;
+    }
+    Level_Cache * cache = get_level_cache(dungeon);
+    Dungeon * level = create_new_dungeon(0, 0);
+    int is_valid = 1;
+    for (int i = 0; i < number_of_levels && is_valid; i++) {
+        int depth = (int32_t) read_save_u32(reader);
+        level->player.x = read_save_u8(reader);
+        level->player.y = read_save_u8(reader);
+        is_valid = coordinate_is_on_board(level->player.x, level->player.y) && read_save_level(reader, level);
+        if (is_valid) {
+            size_t size;
+            uint8_t * bytes = capture_level(level, &size);
+            level_cache_put(cache, depth, bytes, size);
+        }
+    }
+    free_dungeon(level);
+    return is_valid;
+}
+
+// Clears everything a previous level leaves behind, so the next
+// generate_new_board depends on nothing but the seed.
+void start_fresh_level(Dungeon * dungeon, uint64_t seed) {
+    seed_random_streams(dungeon, seed);
+    reset_arena(dungeon->turn_arena);
+    dungeon->player.x = 0;
+    dungeon->player.y = 0;
+    dungeon->player_is_alive = 1;
+    dungeon->rooms_per_level = NUMBER_OF_ROOMS;
+    dungeon->monsters_per_level = DEFAULT_NUMBER_OF_MONSTERS;
+}
+
+char * get_journal_path() {
+    static char * filepath = NULL;
+    if (RECORD_FILE) {
+        return RECORD_FILE;
+    }
+    if (filepath == NULL) {
+        filepath = malloc(strlen(RLG_DIRECTORY) + 32);
+        sprintf(filepath, "%sjournal-%d", RLG_DIRECTORY, (int) getpid());
+    }
+    return filepath;
+}
+
+// How the keys of the game being played reach it, which a journal has to
+// match to be recovered by this run
+int get_journal_flags() {
+    if (USE_AUTOPILOT) {
+        return JOURNAL_USES_AUTOPILOT;
+    }
+    return SCRIPT_FILE ? JOURNAL_USES_SCRIPT : 0;
+}
+
+int process_is_running(int pid) {
+    return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+// Every run journals to a file named after its process, so games running at
+// the same time never share one. Returns the newest journal whose game is no
+// longer running and was played the same way as this run, or NULL.
+char * find_journal_to_recover() {
+    DIR * directory = opendir(RLG_DIRECTORY);
+    if (!directory) {
+        return NULL;
+    }
+    char * newest = NULL;
+    time_t newest_time = 0;
+    struct dirent * entry;
+    while ((entry = readdir(directory))) {
+        int pid;
+        int length = 0;
+        if (sscanf(entry->d_name, "journal-%d%n", &pid, &length) != 1 || entry->d_name[length] != '\0' || process_is_running(pid)) {
+            continue;
+        }
+        char * path = malloc(strlen(RLG_DIRECTORY) + strlen(entry->d_name) + 1);
+        strcpy(path, RLG_DIRECTORY);
+        strcat(path, entry->d_name);
+        uint8_t header[JOURNAL_MARKER_SIZE + 4];
+        uint32_t flags = 0;
+        struct stat file_stat;
+        int fd = open(path, O_RDONLY);
+        int is_journal = fd != -1 && fstat(fd, &file_stat) == 0 && read(fd, header, sizeof(header)) == sizeof(header) &&
+            memcmp(header, JOURNAL_MARKER, JOURNAL_MARKER_SIZE) == 0;
+        if (is_journal) {
+            memcpy(&flags, header + JOURNAL_MARKER_SIZE, 4);
+            flags = ntohl(flags);
+        }
+        int is_match = is_journal && flags == get_journal_flags();
+        if (fd != -1) {
+            close(fd);
+        }
+        if (is_match && (!newest || file_stat.st_mtime >= newest_time)) {
+            free(newest);
+            newest = path;
+            newest_time = file_stat.st_mtime;
         }
         else {
-            cell.type = TYPE_ROCK;
+            free(path);
         }
-        cell.x = x;
-        cell.y = y;
-        board[y][x] = cell;
-        if (x == WIDTH - 1) {
-            x = 0;
-            y ++;
+    }
+    closedir(directory);
+    return newest;
+}
+
+// Replaces the journal with one that starts from a snapshot of the game as it
+// stands, so recovering never has to replay more than a checkpoint's worth of
+// turns. A recording only ever has the snapshot it started with. A scripted
+// game keeps where it had got to in the script alongside the snapshot.
+void checkpoint_journal(Dungeon * dungeon) {
+    uint32_t game_size;
+    uint8_t * buffer = encode_game(dungeon, JOURNAL_HEADER_SIZE, &game_size);
+    memcpy(buffer, JOURNAL_MARKER, JOURNAL_MARKER_SIZE);
+    put_u32(buffer + JOURNAL_MARKER_SIZE, get_journal_flags());
+    put_u64(buffer + JOURNAL_MARKER_SIZE + 4, SEED);
+    put_u32(buffer + JOURNAL_MARKER_SIZE + 12, SCRIPT_FILE ? ftell(SCRIPT_FILE) : 0);
+    if (game_journal) {
+        close_journal(game_journal);
+    }
+    game_journal = create_journal(get_journal_path(), buffer, JOURNAL_HEADER_SIZE + game_size);
+    free(buffer);
+    journal_turns = 0;
+    if (!game_journal) {
+        stop_journal();
+    }
+}
+
+// A journal left behind means a game never finished, so it is restored from
+// the journal's snapshot and the recorded keys are queued up to replay the
+// turns played since. The journal is renamed to this run's first, so no other
+// run can recover it too. A game on screen is recovered whenever one was left,
+// a headless one only with --recover. Returns 0 if there is nothing to recover.
+int recover_from_journal(Dungeon * dungeon) {
+    char * filepath = find_journal_to_recover();
+    if (!filepath) {
+        if (DO_RECOVER) {
+            printf("There is no unfinished %s game to recover\n", USE_AUTOPILOT ? "autopilot" : SCRIPT_FILE ? "scripted" : "keyboard");
+            exit(1);
+        }
+        return 0;
+    }
+    printf("Recovering the last game from %s\n", filepath);
+    if (HAS_SEED || HAS_NUMBER_OF_ROOMS || HAS_NUMBER_OF_MONSTERS) {
+        printf("Ignoring%s%s%s, the recovered game keeps what it was started with\n",
+            HAS_SEED ? " --seed" : "", HAS_NUMBER_OF_ROOMS ? " --rooms" : "", HAS_NUMBER_OF_MONSTERS ? " --nummon" : "");
+    }
+    int is_claimed = rename(filepath, get_journal_path()) == 0;
+    free(filepath);
+    return is_claimed && start_journal_replay(dungeon, get_journal_path());
+}
+
+// Restores the game from a journal's snapshot and queues up its records, so
+// the game loop plays the recorded turns again exactly as they went. Returns 0
+// if filepath is not a journal.
+int start_journal_replay(Dungeon * dungeon, char * filepath) {
+    int fd = open(filepath, O_RDONLY);
+    struct stat file_stat;
+    if (fd == -1) {
+        printf("Cannot open '%s'\n", filepath);
+        return 0;
+    }
+    if (fstat(fd, &file_stat) == -1 || file_stat.st_size < JOURNAL_HEADER_SIZE + SAVE_HEADER_SIZE) {
+        printf("'%s' is not a journal\n", filepath);
+        close(fd);
+        return 0;
+    }
+    uint8_t * file = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        return 0;
+    }
+    Save_Reader reader;
+    reader.bytes = file + JOURNAL_MARKER_SIZE;
+    reader.length = JOURNAL_HEADER_SIZE + SAVE_HEADER_SIZE - JOURNAL_MARKER_SIZE;
+    reader.offset = 0;
+    reader.overran = 0;
+    uint32_t flags = read_save_u32(&reader);
+    uint64_t seed = read_save_u64(&reader);
+    long script_offset = read_save_u32(&reader);
+    read_save_bytes(&reader, SAVE_FILE_MARKER_SIZE + 4);
+    size_t game_size = read_save_u32(&reader);
+    if (memcmp(file, JOURNAL_MARKER, JOURNAL_MARKER_SIZE) != 0 || game_size > file_stat.st_size - JOURNAL_HEADER_SIZE) {
+        printf("'%s' is not a journal\n", filepath);
+        munmap(file, file_stat.st_size);
+        return 0;
+    }
+    USE_AUTOPILOT = flags & JOURNAL_USES_AUTOPILOT;
+    SEED = seed;
+    if (SCRIPT_FILE && fseek(SCRIPT_FILE, script_offset, SEEK_SET) != 0) {
+        printf("Cannot carry on from byte %ld of the script\n", script_offset);
+        exit(1);
+    }
+    reset_level_arena(dungeon);
+    if (load_board_bytes(dungeon, file + JOURNAL_HEADER_SIZE, game_size, filepath) < 1) {
+        printf("'%s' does not start with a saved game\n", filepath);
+        exit(1);
+    }
+    journal_replay.start = JOURNAL_HEADER_SIZE + game_size;
+    journal_replay.length = file_stat.st_size - journal_replay.start;
+    journal_replay.offset = 0;
+    journal_replay.records = malloc(journal_replay.length + 1);
+    memcpy(journal_replay.records, file + journal_replay.start, journal_replay.length);
+    munmap(file, file_stat.st_size);
+    journal_turns = 0;
+    return 1;
+}
+
+// Called once the replay runs out of records or stops matching the game.
+// Whatever was not replayed, such as a record cut short by the crash, is cut
+// off the journal and recording carries on from there. A recording passed to
+// --replay is never written to: the game quits where it ends, or hands over
+// to the keyboard if it is being watched.
+void finish_journal_replay() {
+    int is_finished = journal_replay.offset == journal_replay.length;
+    free(journal_replay.records);
+    journal_replay.records = NULL;
+    if (REPLAY_FILE) {
+        if (!is_finished) {
+            printf("The replay no longer matches '%s'\n", REPLAY_FILE);
+        }
+        if (IS_HEADLESS || !is_finished) {
+            DO_QUIT = 1;
         }
         else {
-            x ++;
+            add_message("That is the end of the recording, it's your turn");
         }
+        return;
+    }
+    game_journal = reopen_journal(get_journal_path(), journal_replay.start + journal_replay.offset);
+    if (!game_journal) {
+        stop_journal();
     }
+}
 
-    uint8_t start_x;
-    uint8_t start_y;
-    uint8_t width;
-    uint8_t height;
-    NUMBER_OF_ROOMS = (file_size - ftell(fp)) / 4;
-    rooms = malloc(sizeof(struct Room) * NUMBER_OF_ROOMS);
-    int counter = 0;
-    while(ftell(fp) != file_size) {
-        fread(&start_x, 1, 1, fp);
-        fread(&start_y, 1, 1, fp);
-        fread(&width, 1, 1, fp);
-        fread(&height, 1, 1, fp);
+// The game carries on without a journal if it cannot be written
+void stop_journal() {
+    if (game_journal) {
+        close_journal(game_journal);
+        game_journal = NULL;
+    }
+    if (IS_HEADLESS) {
+        printf("Cannot write %s, this game cannot be recovered\n", get_journal_path());
+    }
+    else {
+        add_message("Cannot write the journal, this game cannot be recovered");
+    }
+}
 
-        struct Room room;
-        room.start_x = start_x;
-        room.start_y = start_y;
-        room.end_x = start_x + width - 1;
-        room.end_y = start_y + height - 1;
-        rooms[counter] = room;
-        counter ++;
+// A game that finishes has nothing to recover, though a recording is kept
+void end_journal() {
+    if (journal_replay.records) {
+        free(journal_replay.records);
+        journal_replay.records = NULL;
+    }
+    if (game_journal) {
+        close_journal(game_journal);
+        game_journal = NULL;
+    }
+    if (!RECORD_FILE && !REPLAY_FILE) {
+        remove(get_journal_path());
+    }
+}
+
+// Pauses the whole process at a known turn so a profiler or debugger can be
+// attached before carrying on with SIGCONT.
+void stop_at_turn(int turn) {
+    if (IS_HEADLESS) {
+        printf("Stopped at turn %d, continue with: kill -CONT %d\n", turn, (int) getpid());
+        fflush(stdout);
+    }
+    else {
+        char message[100];
+        sprintf(message, "Stopped at turn %d, continue with: kill -CONT %d", turn, (int) getpid());
+        add_message(message);
+    }
+    raise(SIGSTOP);
+}
+
+// Returns the next key being replayed, or -1 once there are none left
+int next_journal_key() {
+    if (!journal_replay.records) {
+        return -1;
+    }
+    uint8_t * record = journal_replay.records + journal_replay.offset;
+    if (journal_replay.length - journal_replay.offset >= JOURNAL_KEY_SIZE && record[0] == JOURNAL_KEY) {
+        journal_replay.offset += JOURNAL_KEY_SIZE;
+        return (record[1] << 8) | record[2];
+    }
+    finish_journal_replay();
+    return -1;
+}
+
+// A game stopped by --turns ends its recording with a stop record, so the
+// replay stops where it did rather than playing the monsters on to the
+// player's next turn. Returns 1 if the game should stop here.
+int next_journal_stop() {
+    if (!journal_replay.records || journal_replay.offset == journal_replay.length) {
+        return 0;
+    }
+    if (journal_replay.records[journal_replay.offset] != JOURNAL_STOP) {
+        return 0;
     }
-    add_rooms_to_board();
-    fclose(fp);
+    journal_replay.offset += JOURNAL_STOP_SIZE;
+    finish_journal_replay();
+    return DO_QUIT;
+}
+
+void record_journal_stop() {
+    uint8_t record[JOURNAL_STOP_SIZE];
+    record[0] = JOURNAL_STOP;
+    append_journal_record(record, JOURNAL_STOP_SIZE);
+}
+
+void record_journal_key(int key) {
+    uint8_t record[JOURNAL_KEY_SIZE];
+    record[0] = JOURNAL_KEY;
+    put_u16(record + 1, key);
+    append_journal_record(record, JOURNAL_KEY_SIZE);
+}
+
+// Every player turn ends with a record of where the AI stream has got to, so
+// a replay that drifts from the recorded game stops at the turn it drifts on
+// instead of carrying on with the wrong keys.
+void record_journal_turn(Dungeon * dungeon) {
+    uint32_t check = dungeon->ai_rng.state;
+    journal_turns ++;
+    if (journal_replay.records) {
+        uint8_t * record = journal_replay.records + journal_replay.offset;
+        if (journal_replay.length - journal_replay.offset >= JOURNAL_TURN_SIZE && record[0] == JOURNAL_TURN) {
+            uint32_t recorded_check = ((uint32_t) record[1] << 24) | (record[2] << 16) | (record[3] << 8) | record[4];
+            if (recorded_check == check) {
+                journal_replay.offset += JOURNAL_TURN_SIZE;
+                return;
+            }
+        }
+        finish_journal_replay();
+    }
+    uint8_t record[JOURNAL_TURN_SIZE];
+    record[0] = JOURNAL_TURN;
+    put_u32(record + 1, check);
+    append_journal_record(record, JOURNAL_TURN_SIZE);
+}
+
+void append_journal_record(uint8_t * record, size_t size) {
+    if (game_journal && !journal_append(game_journal, record, size)) {
+        stop_journal();
+    }
+}
+
+// Every level gets its own seed derived from the base seed and its index,
+// so a batch comes out the same however it is split between workers.
+uint64_t get_batch_level_seed(int index) {
+    Rng rng;
+    rng_seed(&rng, SEED, index);
+    uint64_t high = rng_next(&rng);
+    uint64_t low = rng_next(&rng);
+    return (high << 32) | low;
+}
+
+// Each worker thread owns a dungeon and builds levels w, w + T, w + 2T...
+void generate_batch() {
+    mkdir(BATCH_DIRECTORY, 0777);
+    if (BATCH_WORKERS < 1) {
+        BATCH_WORKERS = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (BATCH_WORKERS > BATCH_SIZE) {
+        BATCH_WORKERS = BATCH_SIZE;
+    }
+    printf("Generating %d levels from seed %llu with %d workers\n", BATCH_SIZE, (unsigned long long) SEED, BATCH_WORKERS);
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    pthread_t * threads = malloc(sizeof(pthread_t) * BATCH_WORKERS);
+    Batch_Worker * workers = malloc(sizeof(Batch_Worker) * BATCH_WORKERS);
+    for (int i = 0; i < BATCH_WORKERS; i++) {
+        workers[i].worker = i;
+        workers[i].number_of_workers = BATCH_WORKERS;
+        workers[i].failed = 0;
+        if (pthread_create(&threads[i], NULL, generate_batch_levels, &workers[i])) {
+            printf("Cannot start worker %d\n", i);
+            exit(1);
+        }
+    }
+    int failed_workers = 0;
+    for (int i = 0; i < BATCH_WORKERS; i++) {
+        pthread_join(threads[i], NULL);
+        failed_workers += workers[i].failed;
+    }
+    free(workers);
+    free(threads);
+    if (failed_workers) {
+        printf("%d of %d workers failed\n", failed_workers, BATCH_WORKERS);
+        exit(1);
+    }
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double seconds = (end_time.tv_sec - start_time.tv_sec) + ((end_time.tv_nsec - start_time.tv_nsec) / 1e9);
+    printf("Wrote %d levels to %s in %.3fs (%.0f levels/s)\n", BATCH_SIZE, BATCH_DIRECTORY, seconds, BATCH_SIZE / seconds);
+}
+
+void * generate_batch_levels(void * data) {
+    Batch_Worker * worker = data;
+    Dungeon * dungeon = create_new_dungeon(NUMBER_OF_ROOMS, DEFAULT_NUMBER_OF_MONSTERS);
+    char * filepath = malloc(strlen(BATCH_DIRECTORY) + 32);
+    for (int i = worker->worker; i < BATCH_SIZE; i += worker->number_of_workers) {
+        start_fresh_level(dungeon, get_batch_level_seed(i));
+        generate_new_board(dungeon);
+        sprintf(filepath, "%s/dungeon%06d", BATCH_DIRECTORY, i);
+        if (!save_board_to(dungeon, filepath)) {
+            worker->failed = 1;
+            break;
+        }
+    }
+    free(filepath);
+    free_dungeon(dungeon);
+    return NULL;
 }
 
 void print_usage() {
-    printf("usage: generate_dungeon [--save] [--load] [--rooms=<number of rooms>] [--player_x=<player x position>] [--player_y=<player y position>] [--nummon=<number of monsters>]\n");
+    printf("usage: generate_dungeon [--save] [--load] [--recover] [--rooms=<number of rooms>] [--player_x=<player x position>] [--player_y=<player y position>] [--nummon=<number of monsters>] [--seed=<seed>] [--heap] [--compare_distances] [--headless] [--script=<input file>] [--turns=<max player turns>] [--bench] [--generate-batch=<number of levels> --out=<directory> [--threads=<workers>]] [--record=<file>] [--replay=<file> [--fast-forward]] [--stop-at-turn=<turn>] [--level-cache=<kilobytes>]\n");
 }
 
-int random_int(int min_num, int max_num, int add_to_seed) {
-    int seed = time(NULL);
-    if (add_to_seed) {
-        seed += add_to_seed;
+void open_script_file(char * path) {
+    SCRIPT_FILE = fopen(path, "r");
+    if (SCRIPT_FILE == NULL) {
+        printf("Cannot open script '%s'\n", path);
+        exit(1);
     }
-    max_num ++;
-    int delta = max_num - min_num;
-    srand(seed);
-    return (rand() % delta) + min_num;
 }
 
-void initialize_board() {
-    Board_Cell cell;
-    cell.type = TYPE_ROCK;
-    cell.has_monster = 0;
-    cell.has_player = 0;
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            cell.x = x;
-            cell.y = y;
-            cell.hardness = random_int(1, 254, x + y);
-            board[y][x] = cell;
-        }
-    }
-    initialize_immutable_rock();
-}
-
-void initialize_immutable_rock() {
-    int y;
-    int x;
-    int max_x = WIDTH - 1;
-    int max_y = HEIGHT - 1;
-    Board_Cell cell;
-    cell.type = TYPE_ROCK;
-    cell.hardness = IMMUTABLE_ROCK;
-    cell.has_monster = 0;
-    cell.has_player = 0;
-    for (y = 0; y < HEIGHT; y++) {
-        cell.y = y;
-        cell.x = 0;
-        board[y][0] = cell;
-        cell.x = max_x;
-        board[y][max_x] = cell;
-    }
-    for (x = 0; x < WIDTH; x++) {
-        cell.y = 0;
-        cell.x = x;
-        board[0][x] = cell;
-        cell.y = max_y;
-        board[max_y][x] = cell;
-    }
-}
-
-void place_player() {
-    if (!player.x && !player.y) {
-        struct Room room = rooms[0];
-        int x = random_int(room.start_x, room.end_x, 100);
-        int y = random_int(room.start_y, room.end_y, 500);
-        player.x = x;
-        player.y = y;
+// Keys left in a recovered journal come first. The script was wound back to
+// where it was at the journal's snapshot, so each of them skips the key in the
+// script it was read from. After that they come from the
+// script in headless mode, one character per key with newlines ignored, and
+// running out of script quits the game. Every new key goes in the journal,
+// which is flushed before waiting on the keyboard so nothing typed is lost if
+// the game is killed while it waits.
+int get_next_key() {
+    int ch = next_journal_key();
+    if (ch != -1) {
+        if (SCRIPT_FILE) {
+            read_script_key();
+        }
+        return ch;
+    }
+    if (DO_QUIT) {
+        return 81; // Q, the recording being replayed has ended
+    }
+    if (!IS_HEADLESS) {
+        if (game_journal && !flush_journal(game_journal)) {
+            stop_journal();
+        }
+        ch = getch();
+    }
+    else if (!SCRIPT_FILE) {
+        ch = 81; // Q, a recovered game has no script to carry on with
+    }
+    else {
+        ch = read_script_key();
+        if (ch == EOF) {
+            ch = 81; // Q
+        }
+    }
+    record_journal_key(ch);
+    return ch;
+}
+
+int read_script_key() {
+    int ch;
+    do {
+        ch = fgetc(SCRIPT_FILE);
+    } while (ch == '\n' || ch == '\r');
+    return ch;
+}
+
+void print_headless_report(Dungeon * dungeon, int turns, int monster_moves, double seconds) {
+    if (!dungeon->player_is_alive) {
+        printf("Outcome: lost, the monsters killed the player\n");
+    }
+    else if (!dungeon->number_of_monsters) {
+        printf("Outcome: won, all the monsters were killed\n");
+    }
+    else if (DO_QUIT) {
+        printf("Outcome: quit\n");
+    }
+    else {
+        printf("Outcome: stopped after %d turns\n", turns);
+    }
+    if (REPLAY_FILE) {
+        printf("Replay: %s\n", REPLAY_FILE);
+    }
+    else {
+        printf("Seed: %llu\n", (unsigned long long) SEED);
+    }
+    printf("Turns: %d (%.0f/s)\n", turns, seconds > 0 ? turns / seconds : 0);
+    printf("Monster moves: %d (%.0f/s)\n", monster_moves, seconds > 0 ? monster_moves / seconds : 0);
+    printf("Elapsed: %.3fs\n", seconds);
+}
+
+// Each subsystem draws from its own stream, so adding a random call to one
+// of them doesn't shift the numbers any of the others see for a given seed.
+void seed_random_streams(Dungeon * dungeon, uint64_t seed) {
+    rng_seed(&dungeon->terrain_rng, seed, STREAM_TERRAIN);
+    rng_seed(&dungeon->rooms_rng, seed, STREAM_ROOMS);
+    rng_seed(&dungeon->monsters_rng, seed, STREAM_MONSTERS);
+    rng_seed(&dungeon->ai_rng, seed, STREAM_AI);
+}
+
+// Fills the whole hardness plane in one pass of vectorized random bytes,
+// then walls it in.
+void initialize_board(Dungeon * dungeon) {
+    memset(dungeon->board.type, TYPE_ROCK, sizeof(dungeon->board.type));
+    memset(dungeon->board.monster_at, 0, sizeof(dungeon->board.monster_at));
+    dungeon->rock_rng = dungeon->terrain_rng;
+    dungeon->has_rock_rng = 1;
+    generate_rock(&dungeon->terrain_rng, dungeon->board.hardness);
+}
+
+void generate_rock(Rng * rng, uint8_t hardness[][WIDTH]) {
+    rng_fill_bytes(rng, &hardness[0][0], HEIGHT * WIDTH, 1, 254);
+    initialize_immutable_rock(hardness);
+}
+
+void initialize_immutable_rock(uint8_t hardness[][WIDTH]) {
+    memset(hardness[0], IMMUTABLE_ROCK, WIDTH);
+    memset(hardness[HEIGHT - 1], IMMUTABLE_ROCK, WIDTH);
+    for (int y = 1; y < HEIGHT - 1; y++) {
+        hardness[y][0] = IMMUTABLE_ROCK;
+        hardness[y][WIDTH - 1] = IMMUTABLE_ROCK;
+    }
+}
+
+void place_player(Dungeon * dungeon) {
+    if (!dungeon->player.x && !dungeon->player.y) {
+        struct Room room = dungeon->rooms[0];
+        int x = rng_int(&dungeon->rooms_rng, room.start_x, room.end_x);
+        int y = rng_int(&dungeon->rooms_rng, room.start_y, room.end_y);
+        dungeon->player.x = x;
+        dungeon->player.y = y;
     }
     struct Coordinate coord;
-    coord.x = player.x;
-    coord.y = player.y;
-    insert_with_priority(game_queue, coord, 0);
+    coord.x = dungeon->player.x;
+    coord.y = dungeon->player.y;
+    insert_with_priority(dungeon->game_queue, coord, 0);
 }
 
-void set_placeable_areas() {
+void set_placeable_areas(Dungeon * dungeon) {
+    dungeon->number_of_placeable_areas = 0;
     for (int y = 0; y < HEIGHT; y++) {
         for (int x = 0; x < WIDTH; x++) {
-            Board_Cell cell = board[y][x];
-            if (cell.hardness == 0 && cell.x != player.x && cell.y != player.y) {
+            if (dungeon->board.hardness[y][x] == 0 && x != dungeon->player.x && y != dungeon->player.y) {
                 struct Coordinate coord;
-                coord.x = cell.x;
-                coord.y = cell.y;
-                placeable_areas[NUMBER_OF_PLACEABLE_AREAS] = coord;
-                NUMBER_OF_PLACEABLE_AREAS++;
+                coord.x = x;
+                coord.y = y;
+                dungeon->placeable_areas[dungeon->number_of_placeable_areas] = coord;
+                dungeon->number_of_placeable_areas++;
             }
         }
     }
 }
 
-int get_cell_weight(Board_Cell cell) {
-    if (cell.hardness == 0) {
+int get_cell_weight(int hardness) {
+    if (hardness == 0) {
         return 1;
     }
-    if (cell.hardness <= 84) {
+    if (hardness <= 84) {
         return 1;
     }
-    if (cell.hardness <= 170) {
+    if (hardness <= 170) {
         return 2;
     }
-    if (cell.hardness <= 254) {
+    if (hardness <= 254) {
         return 3;
     }
     return 1000;
 }
 
-int should_add_tunneling_neighbor(Board_Cell cell) {
-    return cell.hardness < IMMUTABLE_ROCK;
+int should_add_tunneling_neighbor(Dungeon * dungeon, int x, int y) {
+    return dungeon->board.hardness[y][x] < IMMUTABLE_ROCK;
 }
 
-void add_tunneling_neighbor(Neighbors * neighbors, Board_Cell cell) {
-    if (!should_add_tunneling_neighbor(cell)) {
+void add_tunneling_neighbor(Dungeon * dungeon, Neighbors * neighbors, int x, int y) {
+    if (!should_add_tunneling_neighbor(dungeon, x, y)) {
         return;
     }
-    neighbors->cells[neighbors->length] = cell;
+    neighbors->coords[neighbors->length].x = x;
+    neighbors->coords[neighbors->length].y = y;
     neighbors->length ++;
 }
 
 
-Neighbors *get_tunneling_neighbors(struct Coordinate coord) {
+Neighbors get_tunneling_neighbors(Dungeon * dungeon, struct Coordinate coord) {
     int can_go_right = coord.x < WIDTH -1;
     int can_go_up = coord.y > 0;
     int can_go_left = coord.x > 0;
     int can_go_down = coord.y < HEIGHT -1;
-    Neighbors *neighbors = malloc(sizeof(Neighbors));
-    neighbors->cells = malloc(sizeof(Board_Cell) * 8);
+    Neighbors neighbors;
+    neighbors.length = 0;
 
     if (can_go_right) {
-        Board_Cell right = board[coord.y][coord.x + 1];
-        add_tunneling_neighbor(neighbors, right);
+        add_tunneling_neighbor(dungeon, &neighbors, coord.x + 1, coord.y);
         if (can_go_up) {
-            Board_Cell top_right = board[coord.y - 1][coord.x + 1];
-            add_tunneling_neighbor(neighbors, top_right);
+            add_tunneling_neighbor(dungeon, &neighbors, coord.x + 1, coord.y - 1);
         }
         if (can_go_down) {
-            Board_Cell bottom_right = board[coord.y + 1][coord.x + 1];
-            add_tunneling_neighbor(neighbors, bottom_right);
+            add_tunneling_neighbor(dungeon, &neighbors, coord.x + 1, coord.y + 1);
         }
     }
     if (can_go_left) {
-        Board_Cell left = board[coord.y][coord.x - 1];
-        add_tunneling_neighbor(neighbors, left);
+        add_tunneling_neighbor(dungeon, &neighbors, coord.x - 1, coord.y);
         if (can_go_up) {
-            Board_Cell top_left = board[coord.y - 1][coord.x - 1];
-            add_tunneling_neighbor(neighbors, top_left);
+            add_tunneling_neighbor(dungeon, &neighbors, coord.x - 1, coord.y - 1);
         }
         if (can_go_down) {
-            Board_Cell bottom_left = board[coord.y + 1][coord.x - 1];
-            add_tunneling_neighbor(neighbors, bottom_left);
+            add_tunneling_neighbor(dungeon, &neighbors, coord.x - 1, coord.y + 1);
+        }
+    }
+
+    if (can_go_up) {
+        add_tunneling_neighbor(dungeon, &neighbors, coord.x, coord.y - 1);
+    }
+    if (can_go_down) {
+        add_tunneling_neighbor(dungeon, &neighbors, coord.x, coord.y + 1);
+    }
+
+    return neighbors;
+}
+
+
+void set_tunneling_distance_to_player(Dungeon * dungeon) {
+    if (USE_BUCKET_QUEUE) {
+        set_tunneling_distance_with_bucket_queue(dungeon);
+    }
+    else {
+        set_tunneling_distance_with_priority_queue(dungeon);
+    }
+}
+
+// Passable cells weigh 1, 2 or 3, so Dial's algorithm only ever needs four
+// buckets. Cells start unqueued and are pushed the first time they're reached.
+void set_tunneling_distance_with_bucket_queue(Dungeon * dungeon) {
+    if (!dungeon->tunneling_bucket_queue) {
+        dungeon->tunneling_bucket_queue = create_new_bucket_queue(MAX_TUNNELING_WEIGHT, WIDTH, HEIGHT);
+    }
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            dungeon->board.tunneling_distance[y][x] = UNREACHABLE;
+        }
+    }
+    dungeon->board.tunneling_distance[dungeon->player.y][dungeon->player.x] = 0;
+    bucket_insert_with_priority(dungeon->tunneling_bucket_queue, dungeon->player, 0);
+    spread_tunneling_distance(dungeon);
+}
+
+// Runs Dijkstra on whatever is already in the bucket queue, lowering the
+// distance of every cell that can be reached more cheaply.
+void spread_tunneling_distance(Dungeon * dungeon) {
+    while(dungeon->tunneling_bucket_queue->length) {
+        Node min = bucket_extract_min(dungeon->tunneling_bucket_queue);
+        struct Coordinate min_coord = min.coord;
+        Neighbors neighbors = get_tunneling_neighbors(dungeon, min_coord);
+        int min_dist = dungeon->board.tunneling_distance[min_coord.y][min_coord.x] + get_cell_weight(dungeon->board.hardness[min_coord.y][min_coord.x]);
+        for (int i = 0; i < neighbors.length; i++) {
+            struct Coordinate coord = neighbors.coords[i];
+            if (min_dist < dungeon->board.tunneling_distance[coord.y][coord.x]) {
+                bucket_insert_with_priority(dungeon->tunneling_bucket_queue, coord, min_dist);
+                dungeon->board.tunneling_distance[coord.y][coord.x] = min_dist;
+            }
         }
     }
+}
 
-    if (can_go_up) {
-        Board_Cell above = board[coord.y - 1][coord.x];
-        add_tunneling_neighbor(neighbors, above);
+// Lowering a cell's hardness can only lower its weight, and a cell's weight
+// is only paid when leaving it. So the only distances that can change are
+// the ones reachable through its neighbors, and only downwards.
+void repair_tunneling_distance_at(Dungeon * dungeon, struct Coordinate coord) {
+    if (!dungeon->tunneling_bucket_queue) {
+        dungeon->tunneling_bucket_queue = create_new_bucket_queue(MAX_TUNNELING_WEIGHT, WIDTH, HEIGHT);
     }
-    if (can_go_down) {
-        Board_Cell below = board[coord.y + 1][coord.x];
-        add_tunneling_neighbor(neighbors, below);
+    if (dungeon->board.tunneling_distance[coord.y][coord.x] == UNREACHABLE) {
+        return;
     }
-
-    return neighbors;
+    int new_dist = dungeon->board.tunneling_distance[coord.y][coord.x] + get_cell_weight(dungeon->board.hardness[coord.y][coord.x]);
+    Neighbors neighbors = get_tunneling_neighbors(dungeon, coord);
+    for (int i = 0; i < neighbors.length; i++) {
+        struct Coordinate neighbor_coord = neighbors.coords[i];
+        if (new_dist < dungeon->board.tunneling_distance[neighbor_coord.y][neighbor_coord.x]) {
+            bucket_insert_with_priority(dungeon->tunneling_bucket_queue, neighbor_coord, new_dist);
+            dungeon->board.tunneling_distance[neighbor_coord.y][neighbor_coord.x] = new_dist;
+        }
+    }
+    spread_tunneling_distance(dungeon);
 }
 
+void compare_tunneling_distances(Dungeon * dungeon) {
+    uint16_t (* bucket_distances)[WIDTH] = malloc(sizeof(dungeon->board.tunneling_distance));
+    set_tunneling_distance_with_bucket_queue(dungeon);
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            bucket_distances[y][x] = dungeon->board.tunneling_distance[y][x];
+        }
+    }
+    set_tunneling_distance_with_priority_queue(dungeon);
+    int mismatches = 0;
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            if (bucket_distances[y][x] != dungeon->board.tunneling_distance[y][x]) {
+                mismatches ++;
+            }
+        }
+    }
+    free(bucket_distances);
+    printf("Tunneling distances: %d of %d cells differ between the bucket and heap queues\n", mismatches, HEIGHT * WIDTH);
+}
 
-void set_tunneling_distance_to_player() {
-    Queue * tunneling_queue = create_new_queue(HEIGHT * WIDTH);
+void set_tunneling_distance_with_priority_queue(Dungeon * dungeon) {
+    if (!dungeon->tunneling_heap_queue) {
+        dungeon->tunneling_heap_queue = create_new_queue(HEIGHT * WIDTH);
+    }
+    Queue * tunneling_queue = dungeon->tunneling_heap_queue;
     for (int y = 0; y < HEIGHT; y++) {
         for (int x = 0; x < WIDTH; x++) {
             struct Coordinate coord;
             coord.x = x;
             coord.y = y;
-            if (y == player.y && x == player.x) {
-                board[y][x].tunneling_distance = 0;
+            if (y == dungeon->player.y && x == dungeon->player.x) {
+                dungeon->board.tunneling_distance[y][x] = 0;
             }
             else {
-                board[y][x].tunneling_distance = INT_MAX;
+                dungeon->board.tunneling_distance[y][x] = UNREACHABLE;
             }
-            if (board[y][x].hardness < IMMUTABLE_ROCK) {
-                insert_with_priority(tunneling_queue, coord, board[y][x].tunneling_distance);
+            if (dungeon->board.hardness[y][x] < IMMUTABLE_ROCK) {
+                insert_with_priority(tunneling_queue, coord, dungeon->board.tunneling_distance[y][x]);
             }
         }
     }
-    int count = 0;
     while(tunneling_queue->length) {
         Node min = extract_min(tunneling_queue);
-        Board_Cell min_cell = board[min.coord.y][min.coord.x];
-        Neighbors * neighbors = get_tunneling_neighbors(min.coord);
-        int min_dist = min_cell.tunneling_distance + get_cell_weight(min_cell);
-        for (int i = 0; i < neighbors->length; i++) {
-            Board_Cell neighbor_cell = neighbors->cells[i];
-            Board_Cell cell = board[neighbor_cell.y][neighbor_cell.x];
-            if (min_dist < cell.tunneling_distance) {
-                struct Coordinate coord;
-                coord.x = cell.x;
-                coord.y = cell.y;
-                board[cell.y][cell.x].tunneling_distance = min_dist;
+        struct Coordinate min_coord = min.coord;
+        Neighbors neighbors = get_tunneling_neighbors(dungeon, min_coord);
+        int min_dist = dungeon->board.tunneling_distance[min_coord.y][min_coord.x] + get_cell_weight(dungeon->board.hardness[min_coord.y][min_coord.x]);
+        for (int i = 0; i < neighbors.length; i++) {
+            struct Coordinate coord = neighbors.coords[i];
+            if (min_dist < dungeon->board.tunneling_distance[coord.y][coord.x]) {
+                dungeon->board.tunneling_distance[coord.y][coord.x] = min_dist;
                 decrease_priority(tunneling_queue, coord, min_dist);
             }
         }
-        count ++;
     }
 };
 
-int should_add_non_tunneling_neighbor(Board_Cell cell) {
-    return cell.hardness < 1;
+int should_add_non_tunneling_neighbor(Dungeon * dungeon, int x, int y) {
+    return dungeon->board.hardness[y][x] < 1;
 }
 
-void add_non_tunneling_neighbor(Neighbors * neighbors, Board_Cell cell) {
-    if (!should_add_non_tunneling_neighbor(cell)) {
+void add_non_tunneling_neighbor(Dungeon * dungeon, Neighbors * neighbors, int x, int y) {
+    if (!should_add_non_tunneling_neighbor(dungeon, x, y)) {
         return;
     }
-    neighbors->cells[neighbors->length] = cell;
+    neighbors->coords[neighbors->length].x = x;
+    neighbors->coords[neighbors->length].y = y;
     neighbors->length ++;
 }
 
 
-Neighbors *get_non_tunneling_neighbors(struct Coordinate coord) {
+Neighbors get_non_tunneling_neighbors(Dungeon * dungeon, struct Coordinate coord) {
     int can_go_right = coord.x < WIDTH -1;
     int can_go_up = coord.y > 0;
     int can_go_left = coord.x > 0;
     int can_go_down = coord.y < HEIGHT -1;
-    Neighbors *neighbors = malloc(sizeof(Neighbors));
-    neighbors->cells = malloc(sizeof(Board_Cell) * 8);
+    Neighbors neighbors;
+    neighbors.length = 0;
 
     if (can_go_right) {
-        Board_Cell right = board[coord.y][coord.x + 1];
-        add_non_tunneling_neighbor(neighbors, right);
+        add_non_tunneling_neighbor(dungeon, &neighbors, coord.x + 1, coord.y);
         if (can_go_up) {
-            Board_Cell top_right = board[coord.y - 1][coord.x + 1];
-            add_non_tunneling_neighbor(neighbors, top_right);
+            add_non_tunneling_neighbor(dungeon, &neighbors, coord.x + 1, coord.y - 1);
         }
         if (can_go_down) {
-            Board_Cell bottom_right = board[coord.y + 1][coord.x + 1];
-            add_non_tunneling_neighbor(neighbors, bottom_right);
+            add_non_tunneling_neighbor(dungeon, &neighbors, coord.x + 1, coord.y + 1);
         }
     }
     if (can_go_left) {
-        Board_Cell left = board[coord.y][coord.x - 1];
-        add_non_tunneling_neighbor(neighbors, left);
+        add_non_tunneling_neighbor(dungeon, &neighbors, coord.x - 1, coord.y);
         if (can_go_up) {
-            Board_Cell top_left = board[coord.y - 1][coord.x - 1];
-            add_non_tunneling_neighbor(neighbors, top_left);
+            add_non_tunneling_neighbor(dungeon, &neighbors, coord.x - 1, coord.y - 1);
         }
         if (can_go_down) {
-            Board_Cell bottom_left = board[coord.y + 1][coord.x - 1];
-            add_non_tunneling_neighbor(neighbors, bottom_left);
+            add_non_tunneling_neighbor(dungeon, &neighbors, coord.x - 1, coord.y + 1);
         }
     }
 
     if (can_go_up) {
-        Board_Cell above = board[coord.y - 1][coord.x];
-        add_non_tunneling_neighbor(neighbors, above);
+        add_non_tunneling_neighbor(dungeon, &neighbors, coord.x, coord.y - 1);
     }
     if (can_go_down) {
-        Board_Cell below = board[coord.y + 1][coord.x];
-        add_non_tunneling_neighbor(neighbors, below);
+        add_non_tunneling_neighbor(dungeon, &neighbors, coord.x, coord.y + 1);
     }
 
     return neighbors;
 }
 
-void set_non_tunneling_distance_to_player() {
-    Queue * non_tunneling_queue = create_new_queue(HEIGHT * WIDTH);
+// Every step costs 1, so a breadth-first frontier visits cells in distance
+// order. A cell is queued at most once, when its distance is first set, so the
+// ring buffer never holds more than HEIGHT * WIDTH coordinates.
+void set_non_tunneling_distance_to_player(Dungeon * dungeon) {
     for (int y = 0; y < HEIGHT; y++) {
         for (int x = 0; x < WIDTH; x++) {
-            struct Coordinate coord;
-            coord.x = x;
-            coord.y = y;
-            if (y == player.y && x == player.x) {
-                board[y][x].non_tunneling_distance = 0;
-            }
-            else {
-                board[y][x].non_tunneling_distance = INT_MAX;
-            }
-            if (board[y][x].hardness < 1) {
-                insert_with_priority(non_tunneling_queue, coord, board[y][x].non_tunneling_distance);
-            }
+            dungeon->board.non_tunneling_distance[y][x] = UNREACHABLE;
         }
     }
-    while(non_tunneling_queue->length) {
-        Node min = extract_min(non_tunneling_queue);
-        Board_Cell min_cell = board[min.coord.y][min.coord.x];
-        Neighbors * neighbors = get_non_tunneling_neighbors(min.coord);
-        int min_dist = min_cell.non_tunneling_distance + 1;
-        for (int i = 0; i < neighbors->length; i++) {
-            Board_Cell neighbor_cell = neighbors->cells[i];
-            Board_Cell cell = board[neighbor_cell.y][neighbor_cell.x];
-            if (min_dist < cell.non_tunneling_distance) {
-                struct Coordinate coord;
-                coord.x = cell.x;
-                coord.y = cell.y;
-                board[cell.y][cell.x].non_tunneling_distance = min_dist;
-                decrease_priority(non_tunneling_queue, coord, min_dist);
+    dungeon->board.non_tunneling_distance[dungeon->player.y][dungeon->player.x] = 0;
+    spread_non_tunneling_distance_from(dungeon, dungeon->player);
+}
+
+// Breadth-first search out of source, whose distance is already set,
+// lowering every cell that can be reached more cheaply through it.
+void spread_non_tunneling_distance_from(Dungeon * dungeon, struct Coordinate source) {
+    int head = 0;
+    int length = 0;
+    dungeon->non_tunneling_frontier[head] = source;
+    length ++;
+    while(length) {
+        struct Coordinate coord = dungeon->non_tunneling_frontier[head];
+        head = (head + 1) % FRONTIER_SIZE;
+        length --;
+        Neighbors neighbors = get_non_tunneling_neighbors(dungeon, coord);
+        int next_dist = dungeon->board.non_tunneling_distance[coord.y][coord.x] + 1;
+        for (int i = 0; i < neighbors.length; i++) {
+            struct Coordinate next_coord = neighbors.coords[i];
+            if (next_dist >= dungeon->board.non_tunneling_distance[next_coord.y][next_coord.x]) {
+                continue;
             }
+            dungeon->board.non_tunneling_distance[next_coord.y][next_coord.x] = next_dist;
+            dungeon->non_tunneling_frontier[(head + length) % FRONTIER_SIZE] = next_coord;
+            length ++;
+        }
+    }
+}
+
+// A cell that just turned into corridor joins the floor graph. It takes its
+// distance from the closest floor neighbor, then shortens paths through it.
+void repair_non_tunneling_distance_at(Dungeon * dungeon, struct Coordinate coord) {
+    Neighbors neighbors = get_non_tunneling_neighbors(dungeon, coord);
+    int new_dist = UNREACHABLE;
+    for (int i = 0; i < neighbors.length; i++) {
+        struct Coordinate neighbor_coord = neighbors.coords[i];
+        if (dungeon->board.non_tunneling_distance[neighbor_coord.y][neighbor_coord.x] != UNREACHABLE) {
+            new_dist = min(new_dist, dungeon->board.non_tunneling_distance[neighbor_coord.y][neighbor_coord.x] + 1);
+        }
+    }
+    if (new_dist >= dungeon->board.non_tunneling_distance[coord.y][coord.x]) {
+        return;
+    }
+    dungeon->board.non_tunneling_distance[coord.y][coord.x] = new_dist;
+    spread_non_tunneling_distance_from(dungeon, coord);
+}
+
+// The distance maps are only read by telepathic + intelligent monsters, so
+// they are rebuilt the first time one asks after the player moves rather
+// than after every move.
+void mark_distance_maps_stale(Dungeon * dungeon) {
+    dungeon->tunneling_map_is_stale = 1;
+    dungeon->non_tunneling_map_is_stale = 1;
+}
+
+void update_tunneling_distance_if_stale(Dungeon * dungeon) {
+    if (dungeon->tunneling_map_is_stale) {
+        set_tunneling_distance_to_player(dungeon);
+        dungeon->tunneling_map_is_stale = 0;
+    }
+}
+
+void update_non_tunneling_distance_if_stale(Dungeon * dungeon) {
+    if (dungeon->non_tunneling_map_is_stale) {
+        set_non_tunneling_distance_to_player(dungeon);
+        dungeon->non_tunneling_map_is_stale = 0;
+    }
+}
+
+void build_tunneling_distance_task(void * data) {
+    set_tunneling_distance_to_player(data);
+}
+
+void build_non_tunneling_distance_task(void * data) {
+    set_non_tunneling_distance_to_player(data);
+}
+
+// The two maps only share reads of hardness, and each writes its own plane
+// with its own queue, so when both are stale they are built side by side on
+// the dungeon's two map workers.
+void update_distance_maps_if_stale(Dungeon * dungeon) {
+    if (USE_MAP_WORKERS && dungeon->tunneling_map_is_stale && dungeon->non_tunneling_map_is_stale) {
+        if (!dungeon->distance_map_pool) {
+            dungeon->distance_map_pool = create_new_thread_pool(2, 2);
+        }
+        thread_pool_submit(dungeon->distance_map_pool, build_tunneling_distance_task, dungeon);
+        thread_pool_submit(dungeon->distance_map_pool, build_non_tunneling_distance_task, dungeon);
+        thread_pool_wait(dungeon->distance_map_pool);
+        dungeon->tunneling_map_is_stale = 0;
+        dungeon->non_tunneling_map_is_stale = 0;
+        return;
+    }
+    update_tunneling_distance_if_stale(dungeon);
+    update_non_tunneling_distance_if_stale(dungeon);
+}
+
+// Knocks a tunneling monster's worth of hardness off the cell, repairing the
+// distance maps for whatever changed. Returns 1 if the cell is open to walk on.
+int dig_into_cell(Dungeon * dungeon, struct Coordinate coord) {
+    int hardness = dungeon->board.hardness[coord.y][coord.x];
+    if (hardness == 0) {
+        return 1;
+    }
+    if (hardness == IMMUTABLE_ROCK) {
+        return 0;
+    }
+    int old_weight = get_cell_weight(hardness);
+    dungeon->board.hardness[coord.y][coord.x] = max(hardness - 85, 0);
+    if (dungeon->board.hardness[coord.y][coord.x] == 0) {
+        dungeon->board.type[coord.y][coord.x] = TYPE_CORRIDOR;
+        if (!dungeon->non_tunneling_map_is_stale) {
+            repair_non_tunneling_distance_at(dungeon, coord);
         }
     }
+    if (!dungeon->tunneling_map_is_stale && get_cell_weight(dungeon->board.hardness[coord.y][coord.x]) < old_weight) {
+        repair_tunneling_distance_at(dungeon, coord);
+    }
+    return dungeon->board.hardness[coord.y][coord.x] == 0;
 }
 
-struct Coordinate get_random_board_location(int seed) {
-    int index = random_int(0, NUMBER_OF_PLACEABLE_AREAS, seed);
-    return placeable_areas[index];
+struct Coordinate get_random_board_location(Dungeon * dungeon) {
+    int index = rng_int(&dungeon->monsters_rng, 0, dungeon->number_of_placeable_areas - 1);
+    return dungeon->placeable_areas[index];
 }
 
-void generate_monsters() {
-    monsters = malloc(sizeof(struct Monster) * NUMBER_OF_MONSTERS);
+void generate_monsters(Dungeon * dungeon) {
+    if (dungeon->number_of_monsters > dungeon->number_of_placeable_areas) {
+        dungeon->number_of_monsters = dungeon->number_of_placeable_areas;
+    }
+    dungeon->monsters = arena_alloc(dungeon->level_arena, sizeof(struct Monster) * dungeon->number_of_monsters);
     struct Coordinate last_known_player_location;
     last_known_player_location.x = 0;
     last_known_player_location.y = 0;
-    for (int i = 0; i < NUMBER_OF_MONSTERS; i++) {
+    for (int i = 0; i < dungeon->number_of_monsters; i++) {
         struct Monster m;
         struct Coordinate coordinate;
-        while (1) {
-            coordinate = get_random_board_location(i);
-            int is_new = 1;
-            for (int j = 0; j < i; j++) {
-                if (monsters[j].x == coordinate.x && monsters[j].y == coordinate.y && monsters[j].x == player.x && monsters[j].y == player.y) {
-                    is_new = 0;
-                    break;
-                }
-            }
-            if (is_new) {
-                break;
-            }
-        }
-        m.speed = random_int(5, 20, i);
+        do {
+            coordinate = get_random_board_location(dungeon);
+        } while (dungeon->board.monster_at[coordinate.y][coordinate.x]);
+        m.speed = rng_int(&dungeon->monsters_rng, 5, 20);
         m.x = coordinate.x;
         m.y = coordinate.y;
         m.last_known_player_location = last_known_player_location;
-        m.decimal_type = random_int(0, 15, i + 1);
-        board[m.y][m.x].has_monster = 1;
-        board[m.y][m.x].monster = m;
-        monsters[i] = m;
-        insert_with_priority(game_queue, coordinate, i + 1);
+        m.decimal_type = rng_int(&dungeon->monsters_rng, 0, 15);
+        dungeon->board.monster_at[m.y][m.x] = i + 1;
+        dungeon->monsters[i] = m;
+        insert_with_priority(dungeon->game_queue, coordinate, i + 1);
     }
 }
 
-void print_non_tunneling_board() {
+void print_non_tunneling_board(Dungeon * dungeon) {
+    update_distance_maps_if_stale(dungeon);
     for (int y = 0; y < HEIGHT; y++) {
         for (int x = 0; x < WIDTH; x++) {
-           Board_Cell cell = board[y][x];
-           if(cell.x == player.x && cell.y == player.y) {
+           if(x == dungeon->player.x && y == dungeon->player.y) {
                printf("@");
            }
            else {
-               if (strcmp(cell.type, TYPE_ROCK) != 0) {
-                   printf("%d", cell.non_tunneling_distance % 10);
+               if (dungeon->board.type[y][x] != TYPE_ROCK) {
+                   printf("%d", dungeon->board.non_tunneling_distance[y][x] % 10);
                }
                else {
                     printf(" ");
@@ -818,19 +2660,19 @@ void print_non_tunneling_board() {
         printf("\n");
     }
 }
-void print_tunneling_board() {
+void print_tunneling_board(Dungeon * dungeon) {
+    update_distance_maps_if_stale(dungeon);
     for (int y = 0; y < HEIGHT; y++) {
         for (int x = 0; x < WIDTH; x++) {
-           Board_Cell cell = board[y][x];
-           if(cell.x == player.x && cell.y == player.y) {
+           if(x == dungeon->player.x && y == dungeon->player.y) {
                printf("@");
            }
            else {
-               if (cell.hardness == IMMUTABLE_ROCK) {
+               if (dungeon->board.hardness[y][x] == IMMUTABLE_ROCK) {
                    printf(" ");
                }
                else {
-                   printf("%d", cell.tunneling_distance % 10);
+                   printf("%d", dungeon->board.tunneling_distance[y][x] % 10);
                }
            }
         }
@@ -840,6 +2682,9 @@ void print_tunneling_board() {
 }
 
 void add_message(char * message) {
+    if (IS_HEADLESS) {
+        return;
+    }
     move(0,0);
     clrtoeol();
     mvprintw(0, 0, "%s", message);
@@ -847,57 +2692,73 @@ void add_message(char * message) {
     refresh();
 }
 
-void update_board_view(int ncurses_start_x, int ncurses_start_y) {
+void invalidate_board_view() {
+    BOARD_VIEW_IS_VALID = 0;
+}
+
+// Fills glyphs with what cells start_x to start_x + length - 1 of row y
+// look like. Both the curses view and print_board draw from it.
+void assemble_board_row(Dungeon * dungeon, int y, int start_x, int length, chtype * glyphs) {
+    uint8_t * types = &dungeon->board.type[y][start_x];
+    uint16_t * monster_at = &dungeon->board.monster_at[y][start_x];
+    for (int i = 0; i < length; i++) {
+        if (monster_at[i]) {
+            glyphs[i] = MONSTER_GLYPHS[dungeon->monsters[monster_at[i] - 1].decimal_type];
+        }
+        else {
+            glyphs[i] = CELL_GLYPHS[types[i]];
+        }
+    }
+    int player_x = dungeon->player.x - start_x;
+    if (dungeon->player_is_alive && dungeon->player.y == y && player_x >= 0 && player_x < length) {
+        glyphs[player_x] = '@';
+    }
+}
+
+// Scrolling shifts every cell, so it redraws the whole view. Otherwise each
+// row only rewrites the span between its first and last changed cells, in
+// one call.
+void update_board_view(Dungeon * dungeon, int ncurses_start_x, int ncurses_start_y) {
+    if (IS_HEADLESS) {
+        return;
+    }
     ncurses_start_x = min(ncurses_start_x + NCURSES_WIDTH, WIDTH - 1);
     ncurses_start_y = min(ncurses_start_y + NCURSES_HEIGHT, HEIGHT - 1);
     ncurses_start_x = max(ncurses_start_x - NCURSES_WIDTH, 0);
     ncurses_start_y = max(ncurses_start_y - NCURSES_HEIGHT, 0);
+    if (ncurses_start_x != ncurses_start_coord.x || ncurses_start_y != ncurses_start_coord.y) {
+        invalidate_board_view();
+    }
     ncurses_start_coord.x = ncurses_start_x;
     ncurses_start_coord.y = ncurses_start_y;
-    int row = 1;
-    for (int y = ncurses_start_y; y <= ncurses_start_y + NCURSES_HEIGHT; y++) {
-        int col = 0;
-        for (int x = ncurses_start_x; x <= ncurses_start_x + NCURSES_WIDTH; x++) {
-            if (PLAYER_IS_ALIVE && y == player.y && x == player.x) {
-                mvprintw(row, col, "@");
-                ncurses_player_coord.x = col;
-                ncurses_player_coord.y = row;
+    int row_length = NCURSES_WIDTH + 1;
+    chtype glyphs[NCURSES_WIDTH + 1];
+    for (int row = 0; row <= NCURSES_HEIGHT; row++) {
+        assemble_board_row(dungeon, ncurses_start_y + row, ncurses_start_x, row_length, glyphs);
+        int first = 0;
+        int last = row_length - 1;
+        if (BOARD_VIEW_IS_VALID) {
+            while (first < row_length && glyphs[first] == board_view_frame[row][first]) {
+                first ++;
             }
-            else if (board[y][x].has_monster == 1) {
-                struct Coordinate coord;
-                coord.x = x;
-                coord.y = y;
-                int index = get_monster_index(coord);
-                mvprintw(row, col, "%x", monsters[index].decimal_type);
+            if (first == row_length) {
+                continue;
             }
-            else {
-                Board_Cell cell = board[y][x];
-                if (strcmp(cell.type, TYPE_UPSTAIR) == 0) {
-                    mvprintw(row, col, "<");
-                }
-                else if (strcmp(cell.type, TYPE_DOWNSTAIR) == 0) {
-                    mvprintw(row, col, ">");
-                }
-                else if (strcmp(cell.type, TYPE_ROCK) == 0) {
-                    mvprintw(row, col, " ");
-                }
-                else if (strcmp(cell.type, TYPE_ROOM) == 0) {
-                    mvprintw(row, col, ".");
-                }
-                else if (strcmp(cell.type, TYPE_CORRIDOR) == 0) {
-                    mvprintw(row, col, "#");
-                }
-                else {
-                    mvprintw(row, col, "F");
-                }
+            while (glyphs[last] == board_view_frame[row][last]) {
+                last --;
             }
-            col ++;
         }
-        row ++;
+        mvaddchnstr(row + 1, first, &glyphs[first], last - first + 1);
+        memcpy(&board_view_frame[row][first], &glyphs[first], sizeof(chtype) * (last - first + 1));
+    }
+    if (dungeon->player_is_alive) {
+        ncurses_player_coord.x = dungeon->player.x - ncurses_start_x;
+        ncurses_player_coord.y = dungeon->player.y - ncurses_start_y + 1;
     }
+    BOARD_VIEW_IS_VALID = 1;
 }
 
-void handle_user_input_for_look_mode(int key) {
+void handle_user_input_for_look_mode(Dungeon * dungeon, int key) {
     int new_x = ncurses_start_coord.x;
     int new_y = ncurses_start_coord.y;
     if(key == 107 || key == 8) { // k - one page up
@@ -914,94 +2775,94 @@ void handle_user_input_for_look_mode(int key) {
     }
     else if (key == 27) { // escape - enter control mode
         IS_CONTROL_MODE = 1;
-        center_board_on_player();
+        center_board_on_player(dungeon);
         add_message("It's your turn");
         return;
     }
     else if (key == 81) { // Q - quit
         DO_QUIT = 1;
     }
-    update_board_view(new_x, new_y);
-    refresh();
+    update_board_view(dungeon, new_x, new_y);
+    if (!IS_HEADLESS) {
+        refresh();
+    }
 }
 
-int handle_user_input(int key) {
+int handle_user_input(Dungeon * dungeon, int key) {
     struct Coordinate new_coord;
-    new_coord.x = player.x;
-    new_coord.y = player.y;
-    char * str = malloc(sizeof(char) * 100);
+    new_coord.x = dungeon->player.x;
+    new_coord.y = dungeon->player.y;
+    char str[100];
     if (key == 107 || key == 8) { // k - one cell up
-        if (board[player.y - 1][player.x].hardness > 0) {
+        if (dungeon->board.hardness[dungeon->player.y - 1][dungeon->player.x] > 0) {
            return 0;
         }
-        new_coord.y = player.y - 1;
+        new_coord.y = dungeon->player.y - 1;
     }
     else if (key == 106 || key == 2) { // j - one cell down
-        if (board[player.y + 1][player.x].hardness > 0) {
+        if (dungeon->board.hardness[dungeon->player.y + 1][dungeon->player.x] > 0) {
             return 0;
         }
-        new_coord.y = player.y + 1;
+        new_coord.y = dungeon->player.y + 1;
     }
     else if (key == 104 || key == 4) { // h - one cell left
-        if (board[player.y][player.x - 1].hardness > 0) {
+        if (dungeon->board.hardness[dungeon->player.y][dungeon->player.x - 1] > 0) {
             return 0;
         }
-        new_coord.x = player.x - 1;
+        new_coord.x = dungeon->player.x - 1;
     }
     else if(key == 108 || key == 6) { // l - one cell right
-        if (board[player.y][player.x + 1].hardness > 0) {
+        if (dungeon->board.hardness[dungeon->player.y][dungeon->player.x + 1] > 0) {
             return 0;
         }
-        new_coord.x = player.x + 1;
+        new_coord.x = dungeon->player.x + 1;
     }
     else if (key == 121 || key == 7) { // y - one cell up-left
-        if (board[player.y - 1][player.x - 1].hardness > 0) {
+        if (dungeon->board.hardness[dungeon->player.y - 1][dungeon->player.x - 1] > 0) {
             return 0;
         }
-        new_coord.x = player.x - 1;
-        new_coord.y = player.y - 1;
+        new_coord.x = dungeon->player.x - 1;
+        new_coord.y = dungeon->player.y - 1;
     }
     else if (key == 117 || key == 9) { // u - one cell up-right
-        if (board[player.y - 1][player.x + 1].hardness > 0) {
+        if (dungeon->board.hardness[dungeon->player.y - 1][dungeon->player.x + 1] > 0) {
             return 0;
         }
-        new_coord.x = player.x + 1;
-        new_coord.y = player.y - 1;
+        new_coord.x = dungeon->player.x + 1;
+        new_coord.y = dungeon->player.y - 1;
     }
     else if (key == 110 || key == 3) { // n - one cell low-right
-        if (board[player.y + 1][player.x + 1].hardness > 0) {
+        if (dungeon->board.hardness[dungeon->player.y + 1][dungeon->player.x + 1] > 0) {
             return 0;
         }
-        new_coord.x = player.x + 1;
-        new_coord.y = player.y + 1;
+        new_coord.x = dungeon->player.x + 1;
+        new_coord.y = dungeon->player.y + 1;
     }
     else if (key == 98 || key == 1) { // b - one cell low-left
-        if (board[player.y + 1][player.x - 1].hardness > 0) {
+        if (dungeon->board.hardness[dungeon->player.y + 1][dungeon->player.x - 1] > 0) {
             return 0;
         }
-        new_coord.x = player.x - 1;
-        new_coord.y = player.y + 1;
+        new_coord.x = dungeon->player.x - 1;
+        new_coord.y = dungeon->player.y + 1;
     }
     else if (key == 60 && IS_CONTROL_MODE) {  // upstairs
-        if (strcmp(board[player.y][player.x].type, TYPE_UPSTAIR) != 0) {
+        if (dungeon->board.type[dungeon->player.y][dungeon->player.x] != TYPE_UPSTAIR) {
            return 0;
         }
         sprintf(str, "You travel upstairs");
         add_message(str);
-        player.x = 0;
-        player.y = 0;
-        generate_new_board();
+        change_level(dungeon, dungeon->depth - 1);
+        invalidate_board_view();
         return 1;
     }
     else if (key == 62) {  // downstairs
-        if (strcmp(board[player.y][player.x].type, TYPE_DOWNSTAIR) != 0) {
+        if (dungeon->board.type[dungeon->player.y][dungeon->player.x] != TYPE_DOWNSTAIR) {
             return 0;
         }
         sprintf(str, "You travel downstairs");
         add_message(str);
-        player.y = 0;
-        player.x = 0;
-        generate_new_board();
+        change_level(dungeon, dungeon->depth + 1);
+        invalidate_board_view();
         return 1;
     }
     else if (key == 32 || key == 5) { // space - rest
@@ -1021,156 +2882,143 @@ int handle_user_input(int key) {
         add_message(str);
         return 0;
     }
-    if (new_coord.x != player.x || new_coord.y != player.y) {
-        kill_player_or_monster_at(new_coord);
-        player.x = new_coord.x;
-        player.y = new_coord.y;
+    if (new_coord.x != dungeon->player.x || new_coord.y != dungeon->player.y) {
+        kill_player_or_monster_at(dungeon, new_coord);
+        dungeon->player.x = new_coord.x;
+        dungeon->player.y = new_coord.y;
     }
     return 1;
 }
 
-void center_board_on_player() {
-    int new_y = player.y - 10;
-    int new_x = player.x - 40;
-    update_board_view(new_x, new_y);
+void center_board_on_player(Dungeon * dungeon) {
+    if (IS_HEADLESS) {
+        return;
+    }
+    int new_y = dungeon->player.y - 10;
+    int new_x = dungeon->player.x - 40;
+    update_board_view(dungeon, new_x, new_y);
     move(ncurses_player_coord.y, ncurses_player_coord.x);
 }
 
-void print_board() {
+void print_board(Dungeon * dungeon) {
+    chtype glyphs[WIDTH];
     for (int y = 0; y < HEIGHT; y++) {
+        assemble_board_row(dungeon, y, 0, WIDTH, glyphs);
         for (int x = 0; x < WIDTH; x++) {
-            if (PLAYER_IS_ALIVE && y == player.y && x == player.x) {
-                printf("@");
-            }
-            else if (board[y][x].has_monster == 1) {
-                struct Coordinate coord;
-                coord.x = x;
-                coord.y = y;
-                int index = get_monster_index(coord);
-                printf("%x", monsters[index].decimal_type);
-            }
-            else {
-                print_cell(board[y][x]);
-            }
+            putchar(glyphs[x] & A_CHARTEXT);
         }
         printf("\n");
     }
 }
 
-void print_cell(Board_Cell cell) {
-    if (strcmp(cell.type, TYPE_ROCK) == 0) {
-        printf(" ");
-    }
-    else if (strcmp(cell.type, TYPE_ROOM) == 0) {
-        printf(".");
-    }
-    else if (strcmp(cell.type, TYPE_CORRIDOR) == 0) {
-        printf("#");
-    }
-    else {
-        printf("F");
-    }
-}
-
-void dig_rooms(int number_of_rooms_to_dig) {
-    for (int i = 0; i < number_of_rooms_to_dig; i++) {
-        dig_room(i, 0);
-    }
-    add_rooms_to_board();
+// room_map has a bit set for every cell that is in a placed room or the wall
+// of cells around it, so checking a new room doesn't depend on how many rooms
+// there are. If a room still doesn't fit after MAX_ROOM_ATTEMPTS tries the
+// board is as full as it is going to get, and the level keeps the rooms it
+// has.
+void dig_rooms(Dungeon * dungeon, int number_of_rooms_to_dig) {
+    uint64_t room_map[HEIGHT][ROOM_MAP_WORDS];
+    memset(room_map, 0, sizeof(room_map));
+    int number_of_rooms = 0;
+    while (number_of_rooms < number_of_rooms_to_dig && dig_room(dungeon, number_of_rooms, room_map)) {
+        add_room_to_map(dungeon->rooms[number_of_rooms], room_map);
+        number_of_rooms ++;
+    }
+    dungeon->number_of_rooms = number_of_rooms;
+    add_rooms_to_board(dungeon);
 }
 
-void dig_room(int index, int recursive_iteration) {
-    // The index + recusrive_iteration is just a way to gain variety in the
-    // random number. The hope is that it makes the program run faster.
-    int start_x = random_int(1, WIDTH - MIN_ROOM_WIDTH - 1, index + recursive_iteration);
-    int start_y = random_int(1, HEIGHT - MIN_ROOM_HEIGHT - 1, index + recursive_iteration);
-    int room_height = random_int(MIN_ROOM_HEIGHT, MAX_ROOM_HEIGHT, index + recursive_iteration);
-    int room_width = random_int(MIN_ROOM_WIDTH, MAX_ROOM_WIDTH, index + recursive_iteration);
-    int end_y = start_y + room_height;
-    if (end_y >= HEIGHT - 1) {
-        end_y = HEIGHT - 2;
+int dig_room(Dungeon * dungeon, int index, uint64_t room_map[][ROOM_MAP_WORDS]) {
+    for (int attempt = 0; attempt < MAX_ROOM_ATTEMPTS; attempt++) {
+        int start_x = rng_int(&dungeon->rooms_rng, 1, WIDTH - MIN_ROOM_WIDTH - 1);
+        int start_y = rng_int(&dungeon->rooms_rng, 1, HEIGHT - MIN_ROOM_HEIGHT - 1);
+        int room_height = rng_int(&dungeon->rooms_rng, MIN_ROOM_HEIGHT, MAX_ROOM_HEIGHT);
+        int room_width = rng_int(&dungeon->rooms_rng, MIN_ROOM_WIDTH, MAX_ROOM_WIDTH);
+        int end_y = start_y + room_height;
+        if (end_y >= HEIGHT - 1) {
+            end_y = HEIGHT - 2;
 
-    }
-    int end_x = start_x + room_width;
-    if (end_x >= WIDTH - 1) {
-        end_x = WIDTH - 2;
+        }
+        int end_x = start_x + room_width;
+        if (end_x >= WIDTH - 1) {
+            end_x = WIDTH - 2;
 
-    }
-    int height = end_y - start_y;
-    int height_diff = MIN_ROOM_HEIGHT - height;
-    if (height_diff > 0) {
-        start_y -= height_diff + 1;
-    }
+        }
+        int height = end_y - start_y;
+        int height_diff = MIN_ROOM_HEIGHT - height;
+        if (height_diff > 0) {
+            start_y -= height_diff + 1;
+        }
 
-    int width = end_x - start_x;
-    int width_diff = MIN_ROOM_WIDTH - width;
-    if (width_diff > 0) {
-        start_x -= width_diff;
-    }
-    rooms[index].start_x = start_x;
-    rooms[index].start_y = start_y;
-    rooms[index].end_x = end_x;
-    rooms[index].end_y = end_y;
-    if (!room_is_valid_at_index(index)) {
-        dig_room(index, recursive_iteration + 1);
+        int width = end_x - start_x;
+        int width_diff = MIN_ROOM_WIDTH - width;
+        if (width_diff > 0) {
+            start_x -= width_diff;
+        }
+        dungeon->rooms[index].start_x = start_x;
+        dungeon->rooms[index].start_y = start_y;
+        dungeon->rooms[index].end_x = end_x;
+        dungeon->rooms[index].end_y = end_y;
+        if (room_is_valid(dungeon->rooms[index], room_map)) {
+            return 1;
+        }
     }
+    return 0;
 }
 
-int room_is_valid_at_index(int index) {
-    struct Room room = rooms[index];
+// A room is turned down when one of its corners lands in another room or the
+// wall around it, which is the test rooms have always been placed with, so
+// seeds give the same levels as before.
+int room_is_valid(struct Room room, uint64_t room_map[][ROOM_MAP_WORDS]) {
     int width = room.end_x - room.start_x;
     int height = room.end_y - room.start_y;
     if (height < MIN_ROOM_HEIGHT || width < MIN_ROOM_WIDTH) {
         return 0;
     }
-    for (int i = 0; i < index; i++) {
-        struct Room current_room = rooms[i];
-        int start_x = current_room.start_x - 1;
-        int start_y = current_room.start_y - 1;
-        int end_x = current_room.end_x + 1;
-        int end_y = current_room.end_y + 1;
-        if ((room.start_x >= start_x  && room.start_x <= end_x) ||
-                (room.end_x >= start_x && room.end_x <= end_x)) {
-            if ((room.start_y >= start_y && room.start_y <= end_y) ||
-                    (room.end_y >= start_y && room.end_y <= end_y)) {
-                return 0;
-            }
+    return !room_map_has(room_map, room.start_x, room.start_y) &&
+        !room_map_has(room_map, room.end_x, room.start_y) &&
+        !room_map_has(room_map, room.start_x, room.end_y) &&
+        !room_map_has(room_map, room.end_x, room.end_y);
+}
+
+int room_map_has(uint64_t room_map[][ROOM_MAP_WORDS], int x, int y) {
+    return (room_map[y][x / 64] >> (x % 64)) & 1;
+}
+
+void add_room_to_map(struct Room room, uint64_t room_map[][ROOM_MAP_WORDS]) {
+    for (int y = room.start_y - 1; y <= room.end_y + 1; y++) {
+        for (int x = room.start_x - 1; x <= room.end_x + 1; x++) {
+            room_map[y][x / 64] |= (uint64_t) 1 << (x % 64);
         }
     }
-    return 1;
 }
 
-void add_rooms_to_board() {
-    Board_Cell cell;
-    cell.type = TYPE_ROOM;
-    cell.hardness = ROOM;
-    cell.has_monster = 0;
-    cell.has_player = 0;
-    for(int i = 0; i < NUMBER_OF_ROOMS; i++) {
-        struct Room room = rooms[i];
+void add_rooms_to_board(Dungeon * dungeon) {
+    for(int i = 0; i < dungeon->number_of_rooms; i++) {
+        struct Room room = dungeon->rooms[i];
         for (int y = room.start_y; y <= room.end_y; y++) {
             for(int x = room.start_x; x <= room.end_x; x++) {
-                cell.x = x;
-                cell.y = y;
-                board[y][x] = cell;
+                dungeon->board.type[y][x] = TYPE_ROOM;
+                dungeon->board.hardness[y][x] = ROOM;
+                dungeon->board.monster_at[y][x] = 0;
             }
         }
     }
 }
 
-void dig_cooridors() {
-    for (int i = 0; i < NUMBER_OF_ROOMS; i++) {
+void dig_cooridors(Dungeon * dungeon) {
+    for (int i = 0; i < dungeon->number_of_rooms; i++) {
         int next_index = i + 1;
-        if (next_index == NUMBER_OF_ROOMS) {
+        if (next_index == dungeon->number_of_rooms) {
             next_index = 0;
         }
-        connect_rooms_at_indexes(i, next_index);
+        connect_rooms_at_indexes(dungeon, i, next_index);
     }
 }
 
-void connect_rooms_at_indexes(int index1, int index2) {
-    struct Room room1 = rooms[index1];
-    struct Room room2 = rooms[index2];
+void connect_rooms_at_indexes(Dungeon * dungeon, int index1, int index2) {
+    struct Room room1 = dungeon->rooms[index1];
+    struct Room room2 = dungeon->rooms[index2];
     int start_x = ((room1.end_x - room1.start_x) / 2) + room1.start_x;
     int end_x = ((room2.end_x - room2.start_x) / 2) + room2.start_x;
     int start_y = ((room1.end_y - room1.start_y) / 2) + room1.start_y;
@@ -1186,9 +3034,8 @@ void connect_rooms_at_indexes(int index1, int index2) {
     int cur_x = start_x;
     int cur_y = start_y;
     while(1) {
-        int random_num = random_int(0, RAND_MAX, cur_x + cur_y) >> 3;
-        int move_y = random_num % 2 == 0;
-        if (strcmp(board[cur_y][cur_x].type,  TYPE_ROCK) != 0) {
+        int move_y = rng_int(&dungeon->terrain_rng, 0, 1);
+        if (dungeon->board.type[cur_y][cur_x] != TYPE_ROCK) {
             if (cur_y != end_y) {
                 cur_y += y_incrementer;
             }
@@ -1200,14 +3047,9 @@ void connect_rooms_at_indexes(int index1, int index2) {
             }
             continue;
         }
-        Board_Cell corridor_cell;
-        corridor_cell.type = TYPE_CORRIDOR;
-        corridor_cell.hardness = CORRIDOR;
-        corridor_cell.has_monster = 0;
-        corridor_cell.has_player = 0;
-        corridor_cell.x = cur_x;
-        corridor_cell.y = cur_y;
-        board[cur_y][cur_x] = corridor_cell;
+        dungeon->board.type[cur_y][cur_x] = TYPE_CORRIDOR;
+        dungeon->board.hardness[cur_y][cur_x] = CORRIDOR;
+        dungeon->board.monster_at[cur_y][cur_x] = 0;
         if ((cur_y != end_y && move_y) || (cur_x == end_x)) {
             cur_y += y_incrementer;
         }
@@ -1220,69 +3062,61 @@ void connect_rooms_at_indexes(int index1, int index2) {
     }
 }
 
-int get_monster_index(struct Coordinate coord) {
-    int index = -1;
-    for (int i = 0; i < NUMBER_OF_MONSTERS; i++) {
-        struct Monster m = monsters[i];
-        if (m.x == coord.x && m.y == coord.y) {
-            index = i;
-            break;
-        }
-    }
-    return index;
+int get_monster_index(Dungeon * dungeon, struct Coordinate coord) {
+    return dungeon->board.monster_at[coord.y][coord.x] - 1;
 }
 
-struct Available_Coords get_non_tunneling_available_coords_for(struct Coordinate coord) {
+struct Available_Coords get_non_tunneling_available_coords_for(Dungeon * dungeon, struct Coordinate coord) {
     int x = coord.x;
     int y = coord.y;
     struct Available_Coords available_coords;
     struct Coordinate new_coord;
     int size = 0;
     available_coords.length = 0;
-    available_coords.coords = malloc(sizeof(struct Coordinate) * 8);
-    if (board[y - 1][x].hardness == 0) {
+    available_coords.coords = arena_alloc(dungeon->turn_arena, sizeof(struct Coordinate) * 8);
+    if (dungeon->board.hardness[y - 1][x] == 0) {
         new_coord.y = y - 1;
         new_coord.x = x;
         available_coords.coords[size] = new_coord;
         size++;
     }
-    if (board[y - 1][x - 1].hardness == 0) {
+    if (dungeon->board.hardness[y - 1][x - 1] == 0) {
         new_coord.y = y - 1;
         new_coord.x = x - 1;
         available_coords.coords[size] = new_coord;
         size++;
     }
-    if(board[y - 1][x + 1].hardness == 0) {
+    if(dungeon->board.hardness[y - 1][x + 1] == 0) {
         new_coord.y = y - 1;
         new_coord.x = x + 1;
         available_coords.coords[size] = new_coord;
         size ++;
     }
-    if(board[y + 1][x].hardness == 0) {
+    if(dungeon->board.hardness[y + 1][x] == 0) {
         new_coord.y = y + 1;
         new_coord.x = x;
         available_coords.coords[size] = new_coord;
         size ++;
     }
-    if(board[y + 1][x - 1].hardness == 0) {
+    if(dungeon->board.hardness[y + 1][x - 1] == 0) {
         new_coord.y = y + 1;
         new_coord.x = x - 1;
         available_coords.coords[size] = new_coord;
         size ++;
     }
-    if(board[y + 1][x + 1].hardness == 0) {
+    if(dungeon->board.hardness[y + 1][x + 1] == 0) {
         new_coord.y = y + 1;
         new_coord.x = x + 1;
         available_coords.coords[size] = new_coord;
         size++;
     }
-    if(board[y][x - 1].hardness == 0) {
+    if(dungeon->board.hardness[y][x - 1] == 0) {
         new_coord.y = y;
         new_coord.x = x - 1;
         available_coords.coords[size] = new_coord;
         size ++;
     }
-    if (board[y][x + 1].hardness == 0) {
+    if (dungeon->board.hardness[y][x + 1] == 0) {
         new_coord.y = y;
         new_coord.x = x + 1;
         available_coords.coords[size] = new_coord;
@@ -1292,17 +3126,20 @@ struct Available_Coords get_non_tunneling_available_coords_for(struct Coordinate
     return available_coords;
 }
 
-struct Coordinate get_random_new_non_tunneling_location(struct Coordinate coord) {
+struct Coordinate get_random_new_non_tunneling_location(Dungeon * dungeon, struct Coordinate coord) {
     struct Coordinate new_coord;
-    struct Available_Coords coords = get_non_tunneling_available_coords_for(coord);
-    int new_coord_index = random_int(0, coords.length - 1, coord.x + coord.y);
+    struct Available_Coords coords = get_non_tunneling_available_coords_for(dungeon, coord);
+    if (!coords.length) {
+        return coord;
+    }
+    int new_coord_index = rng_int(&dungeon->ai_rng, 0, coords.length - 1);
     struct Coordinate temp_coord = coords.coords[new_coord_index];
     new_coord.x = temp_coord.x;
     new_coord.y = temp_coord.y;
     return new_coord;
 }
 
-struct Coordinate get_random_new_tunneling_location(struct Coordinate coord) {
+struct Coordinate get_random_new_tunneling_location(Dungeon * dungeon, struct Coordinate coord) {
     struct Coordinate new_coord;
     new_coord.x = coord.x;
     new_coord.y = coord.y;
@@ -1324,12 +3161,12 @@ struct Coordinate get_random_new_tunneling_location(struct Coordinate coord) {
     }
     int local_counter = 0;
     while(1) {
-        new_coord.x = random_int(min_x, max_x, local_counter);
-        new_coord.y = random_int(min_y, max_y, local_counter);
+        new_coord.x = rng_int(&dungeon->ai_rng, min_x, max_x);
+        new_coord.y = rng_int(&dungeon->ai_rng, min_y, max_y);
         if (coord.x == new_coord.x && coord.y == new_coord.y) {
             continue;
         }
-        if (board[new_coord.y][new_coord.x].hardness != IMMUTABLE_ROCK) {
+        if (dungeon->board.hardness[new_coord.y][new_coord.x] != IMMUTABLE_ROCK) {
             break;
         }
         local_counter ++;
@@ -1338,47 +3175,57 @@ struct Coordinate get_random_new_tunneling_location(struct Coordinate coord) {
 }
 
 
-void move_player() {
+void move_player(Dungeon * dungeon) {
     int found_monster = 0;
     struct Coordinate new_coord;
-    struct Available_Coords coords = get_non_tunneling_available_coords_for(player);
+    struct Available_Coords coords = get_non_tunneling_available_coords_for(dungeon, dungeon->player);
     for (int i = 0; i < coords.length; i++) {
         struct Coordinate current_coord = coords.coords[i];
-        if (board[current_coord.y][current_coord.x].has_monster) {
+        if (dungeon->board.monster_at[current_coord.y][current_coord.x]) {
             found_monster = 1;
             new_coord = current_coord;
             break;
         }
     }
     if (!found_monster) {
-        new_coord = get_random_new_non_tunneling_location(player);
+        new_coord = get_random_new_non_tunneling_location(dungeon, dungeon->player);
     }
-    if (new_coord.x != player.x || new_coord.y != player.y) {
-        kill_player_or_monster_at(new_coord);
+    if (new_coord.x != dungeon->player.x || new_coord.y != dungeon->player.y) {
+        kill_player_or_monster_at(dungeon, new_coord);
     }
-    player.x = new_coord.x;
-    player.y = new_coord.y;
+    dungeon->player.x = new_coord.x;
+    dungeon->player.y = new_coord.y;
 }
 
-Board_Cell * get_surrounding_cells(struct Coordinate c) {
-    Board_Cell * cells = malloc(sizeof(Board_Cell) * 8);
-    cells[0] = board[c.y + 1][c.x];
-    cells[1] = board[c.y + 1][c.x - 1];
-    cells[2] = board[c.y + 1][c.x + 1];
-    cells[3] = board[c.y - 1][c.x];
-    cells[4] = board[c.y - 1][c.x + 1];
-    cells[5] = board[c.y - 1][c.x - 1];
-    cells[6] = board[c.y][c.x + 1];
-    cells[7] = board[c.y][c.x - 1];
+Neighbors get_surrounding_cells(struct Coordinate c) {
+    Neighbors cells;
+    cells.length = 8;
+    cells.coords[0].x = c.x;
+    cells.coords[0].y = c.y + 1;
+    cells.coords[1].x = c.x - 1;
+    cells.coords[1].y = c.y + 1;
+    cells.coords[2].x = c.x + 1;
+    cells.coords[2].y = c.y + 1;
+    cells.coords[3].x = c.x;
+    cells.coords[3].y = c.y - 1;
+    cells.coords[4].x = c.x + 1;
+    cells.coords[4].y = c.y - 1;
+    cells.coords[5].x = c.x - 1;
+    cells.coords[5].y = c.y - 1;
+    cells.coords[6].x = c.x + 1;
+    cells.coords[6].y = c.y;
+    cells.coords[7].x = c.x - 1;
+    cells.coords[7].y = c.y;
     return cells;
 }
 
-Board_Cell get_cell_on_tunneling_path(struct Coordinate c) {
-    Board_Cell *cells = get_surrounding_cells(c);
-    Board_Cell cell = board[c.y][c.x];
-    for (int i = 0; i < 8; i++) {
-        Board_Cell current_cell = cells[i];
-        if (current_cell.tunneling_distance < cell.tunneling_distance) {
+struct Coordinate get_cell_on_tunneling_path(Dungeon * dungeon, struct Coordinate c) {
+    update_distance_maps_if_stale(dungeon);
+    Neighbors cells = get_surrounding_cells(c);
+    struct Coordinate cell = c;
+    for (int i = 0; i < cells.length; i++) {
+        struct Coordinate current_cell = cells.coords[i];
+        if (dungeon->board.tunneling_distance[current_cell.y][current_cell.x] < dungeon->board.tunneling_distance[cell.y][cell.x]) {
             cell = current_cell;
         }
     }
@@ -1386,30 +3233,31 @@ Board_Cell get_cell_on_tunneling_path(struct Coordinate c) {
 }
 
 
-Board_Cell get_cell_on_non_tunneling_path(struct Coordinate c) {
-    Board_Cell *cells = get_surrounding_cells(c);
-    Board_Cell cell = board[c.y][c.x];
-    int min = cell.non_tunneling_distance;
-    for (int i = 0; i < 8; i++) {
-        Board_Cell my_cell = cells[i];
-        if (my_cell.non_tunneling_distance < min) {
+struct Coordinate get_cell_on_non_tunneling_path(Dungeon * dungeon, struct Coordinate c) {
+    update_distance_maps_if_stale(dungeon);
+    Neighbors cells = get_surrounding_cells(c);
+    struct Coordinate cell = c;
+    int min = dungeon->board.non_tunneling_distance[c.y][c.x];
+    for (int i = 0; i < cells.length; i++) {
+        struct Coordinate my_cell = cells.coords[i];
+        if (dungeon->board.non_tunneling_distance[my_cell.y][my_cell.x] < min) {
             cell = my_cell;
-            min = my_cell.non_tunneling_distance;
+            min = dungeon->board.non_tunneling_distance[my_cell.y][my_cell.x];
         }
     }
     return cell;
 }
 
-struct Room get_room_player_is_in() {
+struct Room get_room_player_is_in(Dungeon * dungeon) {
     struct Room room;
     room.start_x = 0;
     room.end_x = 0;
     room.start_y = 0;
     room.end_y = 0;
-    for (int i = 0; i < NUMBER_OF_ROOMS; i++) {
-        struct Room current_room = rooms[i];
-        if (current_room.start_x <= player.x && player.x <= current_room.end_x) {
-            if (current_room.start_y <= player.y && player.y <= current_room.end_y) {
+    for (int i = 0; i < dungeon->number_of_rooms; i++) {
+        struct Room current_room = dungeon->rooms[i];
+        if (current_room.start_x <= dungeon->player.x && dungeon->player.x <= current_room.end_x) {
+            if (current_room.start_y <= dungeon->player.y && dungeon->player.y <= current_room.end_y) {
                 room = current_room;
                 break;
             }
@@ -1418,9 +3266,9 @@ struct Room get_room_player_is_in() {
     return room;
 }
 
-int monster_is_in_same_room_as_player(int index) {
-    struct Monster m = monsters[index];
-    struct Room room = get_room_player_is_in();
+int monster_is_in_same_room_as_player(Dungeon * dungeon, int index) {
+    struct Monster m = dungeon->monsters[index];
+    struct Room room = get_room_player_is_in(dungeon);
     if (room.start_x <= m.x && m.x <= room.end_x) {
         if (room.start_y <= m.y && m.y <= room.end_y) {
             return 1;
@@ -1429,18 +3277,18 @@ int monster_is_in_same_room_as_player(int index) {
     return 0;
 }
 
-int should_do_erratic_behavior(int index) {
-    return random_int(0, 1, index);
+int should_do_erratic_behavior(Dungeon * dungeon, int index) {
+    return rng_int(&dungeon->ai_rng, 0, 1);
 }
 
-int monster_knows_last_player_location(int index) {
-    struct Monster m = monsters[index];
+int monster_knows_last_player_location(Dungeon * dungeon, int index) {
+    struct Monster m = dungeon->monsters[index];
     struct Coordinate last_known_player_location = m.last_known_player_location;
     return last_known_player_location.x != 0 && last_known_player_location.y != 0;
 }
 
-struct Coordinate get_straight_path_to(int index, struct Coordinate coord) {
-    struct Monster m = monsters[index];
+struct Coordinate get_straight_path_to(Dungeon * dungeon, int index, struct Coordinate coord) {
+    struct Monster m = dungeon->monsters[index];
     struct Coordinate new_coord;
     if (m.x == coord.x) {
         new_coord.x = m.x;
@@ -1465,335 +3313,245 @@ struct Coordinate get_straight_path_to(int index, struct Coordinate coord) {
     return new_coord;
 }
 
-void kill_monster_at(int index) {
-    struct Monster m = monsters[index];
-    board[m.y][m.x].has_monster = 0;
-    for (int i = index + 1; i < NUMBER_OF_MONSTERS; i++) {
-        monsters[i - 1] = monsters[i];
+// Monster order doesn't matter, so the last monster is moved into the dead
+// one's slot instead of shifting everything after it down.
+void kill_monster_at(Dungeon * dungeon, int index) {
+    struct Monster m = dungeon->monsters[index];
+    dungeon->board.monster_at[m.y][m.x] = 0;
+    dungeon->number_of_monsters --;
+    if (index != dungeon->number_of_monsters) {
+        struct Monster last = dungeon->monsters[dungeon->number_of_monsters];
+        dungeon->monsters[index] = last;
+        dungeon->board.monster_at[last.y][last.x] = index + 1;
     }
-    NUMBER_OF_MONSTERS --;
 }
 
-void kill_player_or_monster_at(struct Coordinate coord) {
-    int index = get_monster_index(coord);
-    char * str = malloc(sizeof(char) * 100);
+void kill_player_or_monster_at(Dungeon * dungeon, struct Coordinate coord) {
+    int index = get_monster_index(dungeon, coord);
+    char str[100];
     if (index >= 0) {
-        sprintf(str, "Monster with ability %d was killed!\n", monsters[index].decimal_type);
+        sprintf(str, "Monster with ability %d was killed!\n", dungeon->monsters[index].decimal_type);
         add_message(str);
-        kill_monster_at(index);
+        kill_monster_at(dungeon, index);
     }
-    if (player.x == coord.x && player.y == coord.y) {
-        PLAYER_IS_ALIVE = 0;
+    if (dungeon->player.x == coord.x && dungeon->player.y == coord.y) {
+        dungeon->player_is_alive = 0;
         add_message("The player was killed!\n");
     }
 }
 
-void move_monster_at_index(int index) {
-    struct Monster monster = monsters[index];
-    Board_Cell cell = board[monster.y][monster.x];
+// Returns the monster's index afterwards, which changes if it kills the
+// monster it moves onto and gets swapped into that monster's slot.
+int move_monster_at_index(Dungeon * dungeon, int index) {
+    struct Monster monster = dungeon->monsters[index];
     struct Coordinate monster_coord;
     monster_coord.x = monster.x;
     monster_coord.y = monster.y;
     struct Coordinate new_coord;
     new_coord.x = monster.x;
     new_coord.y = monster.y;
-    board[new_coord.y][new_coord.x].has_monster = 0;
     switch(monster.decimal_type) {
         case 0: // nothing
-            if (monster_is_in_same_room_as_player(index)) {
-                new_coord = get_straight_path_to(index, player);
+            if (monster_is_in_same_room_as_player(dungeon, index)) {
+                new_coord = get_straight_path_to(dungeon, index, dungeon->player);
             }
             else {
-                new_coord = get_random_new_non_tunneling_location(monster_coord);
+                new_coord = get_random_new_non_tunneling_location(dungeon, monster_coord);
             }
             break;
         case 1: // intelligent
-            if (monster_is_in_same_room_as_player(index)) {
-                monsters[index].last_known_player_location = player;
-                new_coord = get_straight_path_to(index, player);
+            if (monster_is_in_same_room_as_player(dungeon, index)) {
+                dungeon->monsters[index].last_known_player_location = dungeon->player;
+                new_coord = get_straight_path_to(dungeon, index, dungeon->player);
             }
-            else if(monster_knows_last_player_location(index)) {
-                new_coord = get_straight_path_to(index, monster.last_known_player_location);
+            else if(monster_knows_last_player_location(dungeon, index)) {
+                new_coord = get_straight_path_to(dungeon, index, monster.last_known_player_location);
                 if (new_coord.x == monster.last_known_player_location.x && new_coord.y == monster.last_known_player_location.y) {
-                    monsters[index].last_known_player_location.x = 0;
-                    monsters[index].last_known_player_location.y = 0;
+                    dungeon->monsters[index].last_known_player_location.x = 0;
+                    dungeon->monsters[index].last_known_player_location.y = 0;
                 }
             }
             else {
-                new_coord = get_random_new_non_tunneling_location(monster_coord);
+                new_coord = get_random_new_non_tunneling_location(dungeon, monster_coord);
             }
             break;
         case 2: // telepathic
-            new_coord = get_straight_path_to(index, player);
-            if (board[new_coord.y][new_coord.x].hardness > 0) {
+            new_coord = get_straight_path_to(dungeon, index, dungeon->player);
+            if (dungeon->board.hardness[new_coord.y][new_coord.x] > 0) {
                 new_coord.x = monster_coord.x;
                 new_coord.y = monster_coord.y;
             }
             break;
         case 3: // telepathic + intelligent
-            cell = get_cell_on_non_tunneling_path(new_coord);
-            new_coord.x = cell.x;
-            new_coord.y = cell.y;
+            new_coord = get_cell_on_non_tunneling_path(dungeon, new_coord);
             break;
         case 4: // tunneling
-            if (monster_is_in_same_room_as_player(index)) {
-                new_coord = get_straight_path_to(index, player);
+            if (monster_is_in_same_room_as_player(dungeon, index)) {
+                new_coord = get_straight_path_to(dungeon, index, dungeon->player);
             }
             else {
-                new_coord = get_random_new_tunneling_location(monster_coord);
+                new_coord = get_random_new_tunneling_location(dungeon, monster_coord);
             }
-            cell = board[new_coord.y][new_coord.x];
-            if (cell.hardness > 0) {
-                board[cell.y][cell.x].hardness -= 85;
-                if (board[cell.y][cell.x].hardness <= 0) {
-                    board[cell.y][cell.x].hardness = 0;
-                    board[cell.y][cell.x].type = TYPE_CORRIDOR;
-                    set_non_tunneling_distance_to_player();
-                }
-                else {
-                    new_coord.x = monster.x;
-                    new_coord.y = monster.y;
-                }
-                set_tunneling_distance_to_player();
+            if (!dig_into_cell(dungeon, new_coord)) {
+                new_coord.x = monster.x;
+                new_coord.y = monster.y;
             }
             break;
         case 5: // tunneling + intelligent
-            if (monster_is_in_same_room_as_player(index)) {
-                monsters[index].last_known_player_location = player;
-                new_coord = get_straight_path_to(index, player);
+            if (monster_is_in_same_room_as_player(dungeon, index)) {
+                dungeon->monsters[index].last_known_player_location = dungeon->player;
+                new_coord = get_straight_path_to(dungeon, index, dungeon->player);
             }
-            else if(monster_knows_last_player_location(index)) {
-                new_coord = get_straight_path_to(index, monster.last_known_player_location);
+            else if(monster_knows_last_player_location(dungeon, index)) {
+                new_coord = get_straight_path_to(dungeon, index, monster.last_known_player_location);
                 if (new_coord.x == monster.last_known_player_location.x && new_coord.y == monster.last_known_player_location.y) {
-                    monsters[index].last_known_player_location.x = 0;
-                    monsters[index].last_known_player_location.y = 0;
+                    dungeon->monsters[index].last_known_player_location.x = 0;
+                    dungeon->monsters[index].last_known_player_location.y = 0;
                 }
             }
             else {
-                new_coord = get_random_new_tunneling_location(monster_coord);
-                cell = board[new_coord.y][new_coord.x];
-                if (cell.hardness > 0) {
-                    board[cell.y][cell.x].hardness -= 85;
-                    if (board[cell.y][cell.x].hardness <= 0) {
-                        board[cell.y][cell.x].hardness = 0;
-                        board[cell.y][cell.x].type = TYPE_CORRIDOR;
-                        set_non_tunneling_distance_to_player();
-                    }
-                    else {
-                        new_coord.x = monster.x;
-                        new_coord.y = monster.y;
-                    }
-                    set_tunneling_distance_to_player();
+                new_coord = get_random_new_tunneling_location(dungeon, monster_coord);
+                if (!dig_into_cell(dungeon, new_coord)) {
+                    new_coord.x = monster.x;
+                    new_coord.y = monster.y;
                 }
             }
             break;
         case 6: // tunneling + telepathic
-            new_coord = get_straight_path_to(index, player);
-            cell = board[new_coord.y][new_coord.x];
-            if (cell.hardness > 0) {
-                board[cell.y][cell.x].hardness -= 85;
-                if (board[cell.y][cell.x].hardness <= 0) {
-                    board[cell.y][cell.x].hardness = 0;
-                    board[cell.y][cell.x].type = TYPE_CORRIDOR;
-                    set_non_tunneling_distance_to_player();
-                }
-                else {
-                    new_coord.x = monster.x;
-                    new_coord.y = monster.y;
-                }
-                set_tunneling_distance_to_player();
+            new_coord = get_straight_path_to(dungeon, index, dungeon->player);
+            if (!dig_into_cell(dungeon, new_coord)) {
+                new_coord.x = monster.x;
+                new_coord.y = monster.y;
             }
             break;
         case 7: // tunneling + telepathic + intelligent
-            cell = get_cell_on_tunneling_path(new_coord);
-            new_coord.x = cell.x;
-            new_coord.y = cell.y;
-            if (cell.hardness > 0) {
-                board[cell.y][cell.x].hardness -= 85;
-                if (board[cell.y][cell.x].hardness <= 0) {
-                    board[cell.y][cell.x].hardness = 0;
-                    board[cell.y][cell.x].type = TYPE_CORRIDOR;
-                    set_non_tunneling_distance_to_player();
-                }
-                else {
-                    new_coord.x = monster.x;
-                    new_coord.y = monster.y;
-                }
-                set_tunneling_distance_to_player();
+            new_coord = get_cell_on_tunneling_path(dungeon, new_coord);
+            if (!dig_into_cell(dungeon, new_coord)) {
+                new_coord.x = monster.x;
+                new_coord.y = monster.y;
             }
             break;
         case 8: // erratic
-            if (should_do_erratic_behavior(index)) {
-                new_coord = get_random_new_non_tunneling_location(monster_coord);
+            if (should_do_erratic_behavior(dungeon, index)) {
+                new_coord = get_random_new_non_tunneling_location(dungeon, monster_coord);
             }
             else {
-                if (monster_is_in_same_room_as_player(index)) {
-                    new_coord = get_straight_path_to(index, player);
+                if (monster_is_in_same_room_as_player(dungeon, index)) {
+                    new_coord = get_straight_path_to(dungeon, index, dungeon->player);
                 }
                 else {
-                    new_coord = get_random_new_non_tunneling_location(monster_coord);
+                    new_coord = get_random_new_non_tunneling_location(dungeon, monster_coord);
                 }
             }
             break;
         case 9: // erratic + intelligent
-            if (should_do_erratic_behavior(index)) {
-                new_coord = get_random_new_non_tunneling_location(monster_coord);
+            if (should_do_erratic_behavior(dungeon, index)) {
+                new_coord = get_random_new_non_tunneling_location(dungeon, monster_coord);
             }
             else {
-                if (monster_is_in_same_room_as_player(index)) {
-                    monsters[index].last_known_player_location = player;
-                    new_coord = get_straight_path_to(index, player);
+                if (monster_is_in_same_room_as_player(dungeon, index)) {
+                    dungeon->monsters[index].last_known_player_location = dungeon->player;
+                    new_coord = get_straight_path_to(dungeon, index, dungeon->player);
                 }
-                else if(monster_knows_last_player_location(index)) {
-                    new_coord = get_straight_path_to(index, monster.last_known_player_location);
+                else if(monster_knows_last_player_location(dungeon, index)) {
+                    new_coord = get_straight_path_to(dungeon, index, monster.last_known_player_location);
                     if (new_coord.x == monster.last_known_player_location.x && new_coord.y == monster.last_known_player_location.y) {
-                        monsters[index].last_known_player_location.x = 0;
-                        monsters[index].last_known_player_location.y = 0;
+                        dungeon->monsters[index].last_known_player_location.x = 0;
+                        dungeon->monsters[index].last_known_player_location.y = 0;
                     }
                 }
                 else {
-                    new_coord = get_random_new_non_tunneling_location(monster_coord);
+                    new_coord = get_random_new_non_tunneling_location(dungeon, monster_coord);
                 }
             }
             break;
         case 10: // erratic + telepathic
-            if (should_do_erratic_behavior(index)) {
-                new_coord = get_random_new_non_tunneling_location(monster_coord);
+            if (should_do_erratic_behavior(dungeon, index)) {
+                new_coord = get_random_new_non_tunneling_location(dungeon, monster_coord);
             }
             else {
-                new_coord = get_straight_path_to(index, player);
-                if (board[new_coord.y][new_coord.x].hardness != 0) {
+                new_coord = get_straight_path_to(dungeon, index, dungeon->player);
+                if (dungeon->board.hardness[new_coord.y][new_coord.x] != 0) {
                     new_coord.x = monster.x;
                     new_coord.y = monster.y;
                 }
             }
             break;
         case 11: // erratic + intelligent + telepathic
-            if (should_do_erratic_behavior(index)) {
-                new_coord = get_random_new_non_tunneling_location(monster_coord);
+            if (should_do_erratic_behavior(dungeon, index)) {
+                new_coord = get_random_new_non_tunneling_location(dungeon, monster_coord);
             }
             else {
-                new_coord = get_straight_path_to(index, player);
-                cell = board[new_coord.y][new_coord.x];
-                if (cell.hardness > 0) {
-                    board[cell.y][cell.x].hardness -= 85;
-                    if (board[cell.y][cell.x].hardness <= 0) {
-                        board[cell.y][cell.x].hardness = 0;
-                        board[cell.y][cell.x].type = TYPE_CORRIDOR;
-                        set_non_tunneling_distance_to_player();
-                    }
-                    else {
-                        new_coord.x = monster.x;
-                        new_coord.y = monster.y;
-                    }
-                    set_tunneling_distance_to_player();
+                new_coord = get_straight_path_to(dungeon, index, dungeon->player);
+                if (!dig_into_cell(dungeon, new_coord)) {
+                    new_coord.x = monster.x;
+                    new_coord.y = monster.y;
                 }
             }
             break;
         case 12: // erratic + tunneling
-            if (should_do_erratic_behavior(index)) {
-                new_coord = get_random_new_non_tunneling_location(monster_coord);
+            if (should_do_erratic_behavior(dungeon, index)) {
+                new_coord = get_random_new_non_tunneling_location(dungeon, monster_coord);
             }
             else {
-                if (monster_is_in_same_room_as_player(index)) {
-                    new_coord = get_straight_path_to(index, player);
+                if (monster_is_in_same_room_as_player(dungeon, index)) {
+                    new_coord = get_straight_path_to(dungeon, index, dungeon->player);
                 }
                 else {
-                    new_coord = get_random_new_tunneling_location(monster_coord);
+                    new_coord = get_random_new_tunneling_location(dungeon, monster_coord);
                 }
-                cell = board[new_coord.y][new_coord.x];
-                if (cell.hardness > 0) {
-                    board[cell.y][cell.x].hardness -= 85;
-                    if (board[cell.y][cell.x].hardness <= 0) {
-                        board[cell.y][cell.x].hardness = 0;
-                        board[cell.y][cell.x].type = TYPE_CORRIDOR;
-                        set_non_tunneling_distance_to_player();
-                    }
-                    else {
-                        new_coord.x = monster.x;
-                        new_coord.y = monster.y;
-                    }
-                    set_tunneling_distance_to_player();
+                if (!dig_into_cell(dungeon, new_coord)) {
+                    new_coord.x = monster.x;
+                    new_coord.y = monster.y;
                 }
             }
             break;
         case 13: // erratic + tunneling + intelligent
-            if (should_do_erratic_behavior(index)) {
-                new_coord = get_random_new_non_tunneling_location(monster_coord);
+            if (should_do_erratic_behavior(dungeon, index)) {
+                new_coord = get_random_new_non_tunneling_location(dungeon, monster_coord);
             }
             else {
-                if (monster_is_in_same_room_as_player(index)) {
-                    monsters[index].last_known_player_location = player;
-                    new_coord = get_straight_path_to(index, player);
+                if (monster_is_in_same_room_as_player(dungeon, index)) {
+                    dungeon->monsters[index].last_known_player_location = dungeon->player;
+                    new_coord = get_straight_path_to(dungeon, index, dungeon->player);
                 }
-                else if(monster_knows_last_player_location(index)) {
-                    new_coord = get_straight_path_to(index, monster.last_known_player_location);
+                else if(monster_knows_last_player_location(dungeon, index)) {
+                    new_coord = get_straight_path_to(dungeon, index, monster.last_known_player_location);
                     if (new_coord.x == monster.last_known_player_location.x && new_coord.y == monster.last_known_player_location.y) {
-                        monsters[index].last_known_player_location.x = 0;
-                        monsters[index].last_known_player_location.y = 0;
+                        dungeon->monsters[index].last_known_player_location.x = 0;
+                        dungeon->monsters[index].last_known_player_location.y = 0;
                     }
                 }
                 else {
-                    new_coord = get_random_new_tunneling_location(monster_coord);
-                    cell = board[new_coord.y][new_coord.x];
-                    if (cell.hardness > 0) {
-                        board[cell.y][cell.x].hardness -= 85;
-                        if (board[cell.y][cell.x].hardness <= 0) {
-                            board[cell.y][cell.x].hardness = 0;
-                            board[cell.y][cell.x].type = TYPE_CORRIDOR;
-                            set_non_tunneling_distance_to_player();
-                        }
-                        else {
-                            new_coord.x = monster.x;
-                            new_coord.y = monster.y;
-                        }
-                        set_tunneling_distance_to_player();
+                    new_coord = get_random_new_tunneling_location(dungeon, monster_coord);
+                    if (!dig_into_cell(dungeon, new_coord)) {
+                        new_coord.x = monster.x;
+                        new_coord.y = monster.y;
                     }
                 }
             }
             break;
         case 14: // erratic + tunneling + telepathic
-            if (should_do_erratic_behavior(index)) {
-                new_coord = get_random_new_non_tunneling_location(monster_coord);
+            if (should_do_erratic_behavior(dungeon, index)) {
+                new_coord = get_random_new_non_tunneling_location(dungeon, monster_coord);
             }
             else {
-                new_coord = get_straight_path_to(index, player);
-                cell = board[new_coord.y][new_coord.x];
-                if (cell.hardness > 0) {
-                    board[cell.y][cell.x].hardness -= 85;
-                    if (board[cell.y][cell.x].hardness <= 0) {
-                        board[cell.y][cell.x].hardness = 0;
-                        board[cell.y][cell.x].type = TYPE_CORRIDOR;
-                        set_non_tunneling_distance_to_player();
-                    }
-                    else {
-                        new_coord.x = monster.x;
-                        new_coord.y = monster.y;
-                    }
-                    set_tunneling_distance_to_player();
+                new_coord = get_straight_path_to(dungeon, index, dungeon->player);
+                if (!dig_into_cell(dungeon, new_coord)) {
+                    new_coord.x = monster.x;
+                    new_coord.y = monster.y;
                 }
             }
             break;
         case 15: // erratic + tunneling + telepathic + intelligent
-            if (should_do_erratic_behavior(index)) {
-                new_coord = get_random_new_non_tunneling_location(monster_coord);
+            if (should_do_erratic_behavior(dungeon, index)) {
+                new_coord = get_random_new_non_tunneling_location(dungeon, monster_coord);
             }
             else {
-                cell = get_cell_on_tunneling_path(new_coord);
-                new_coord.x = cell.x;
-                new_coord.y = cell.y;
-                if (cell.hardness > 0) {
-                    board[cell.y][cell.x].hardness -= 85;
-                    if (board[cell.y][cell.x].hardness <= 0) {
-                        board[cell.y][cell.x].hardness = 0;
-                        board[cell.y][cell.x].type = TYPE_CORRIDOR;
-                        set_non_tunneling_distance_to_player();
-                    }
-                    else {
-                        new_coord.x = monster.x;
-                        new_coord.y = monster.y;
-                    }
-                    set_tunneling_distance_to_player();
+                new_coord = get_cell_on_tunneling_path(dungeon, new_coord);
+                if (!dig_into_cell(dungeon, new_coord)) {
+                    new_coord.x = monster.x;
+                    new_coord.y = monster.y;
                 }
             }
             break;
@@ -1802,9 +3560,274 @@ void move_monster_at_index(int index) {
             break;
     }
     if (new_coord.x != monster.x || new_coord.y != monster.y) {
-        kill_player_or_monster_at(new_coord);
+        kill_player_or_monster_at(dungeon, new_coord);
+    }
+    index = dungeon->board.monster_at[monster.y][monster.x] - 1;
+    dungeon->board.monster_at[monster.y][monster.x] = 0;
+    dungeon->monsters[index].x = new_coord.x;
+    dungeon->monsters[index].y = new_coord.y;
+    dungeon->board.monster_at[new_coord.y][new_coord.x] = index + 1;
+    return index;
+}
+
+struct Coordinate get_benchmark_coordinate(int i) {
+    struct Coordinate coord;
+    coord.x = i & 0xff;
+    coord.y = i >> 8;
+    return coord;
+}
+
+void setup_empty_queue(void * data) {
+    Queue_Benchmark * benchmark = data;
+    benchmark->queue = create_new_queue_in(benchmark->queue, benchmark->size);
+}
+
+void setup_full_queue(void * data) {
+    Queue_Benchmark * benchmark = data;
+    setup_empty_queue(benchmark);
+    for (int i = 0; i < benchmark->size; i++) {
+        insert_with_priority(benchmark->queue, get_benchmark_coordinate(i), benchmark->priorities[i]);
+    }
+}
+
+void bench_insert_with_priority(void * data) {
+    Queue_Benchmark * benchmark = data;
+    for (int i = 0; i < benchmark->size; i++) {
+        insert_with_priority(benchmark->queue, get_benchmark_coordinate(i), benchmark->priorities[i]);
+    }
+}
+
+void bench_extract_min(void * data) {
+    Queue_Benchmark * benchmark = data;
+    for (int i = 0; i < benchmark->size; i++) {
+        extract_min(benchmark->queue);
+    }
+}
+
+void bench_decrease_priority(void * data) {
+    Queue_Benchmark * benchmark = data;
+    for (int i = 0; i < benchmark->size; i++) {
+        decrease_priority(benchmark->queue, get_benchmark_coordinate(i), benchmark->priorities[i] / 2);
+    }
+}
+
+// Puts every benchmark that uses the board back on the same level
+void setup_benchmark_board(void * data) {
+    Board_Benchmark * benchmark = data;
+    start_fresh_level(benchmark->dungeon, BENCHMARK_SEED);
+}
+
+void bench_generate_new_board(void * data) {
+    Board_Benchmark * benchmark = data;
+    generate_new_board(benchmark->dungeon);
+}
+
+void bench_tunneling_distance(void * data) {
+    Board_Benchmark * benchmark = data;
+    set_tunneling_distance_to_player(benchmark->dungeon);
+}
+
+void bench_non_tunneling_distance(void * data) {
+    Board_Benchmark * benchmark = data;
+    set_non_tunneling_distance_to_player(benchmark->dungeon);
+}
+
+void setup_stale_distance_maps(void * data) {
+    Board_Benchmark * benchmark = data;
+    mark_distance_maps_stale(benchmark->dungeon);
+}
+
+void bench_update_distance_maps(void * data) {
+    Board_Benchmark * benchmark = data;
+    update_distance_maps_if_stale(benchmark->dungeon);
+}
+
+void setup_invalid_board_view(void * data) {
+    invalidate_board_view();
+}
+
+void bench_update_board_view(void * data) {
+    Board_Benchmark * benchmark = data;
+    Dungeon * dungeon = benchmark->dungeon;
+    update_board_view(dungeon, dungeon->player.x - (NCURSES_WIDTH / 2), dungeon->player.y - (NCURSES_HEIGHT / 2));
+}
+
+void bench_save_board(void * data) {
+    Board_Benchmark * benchmark = data;
+    save_board_to(benchmark->dungeon, benchmark->filepath);
+}
+
+void bench_save_game(void * data) {
+    Board_Benchmark * benchmark = data;
+    save_game_to(benchmark->dungeon, benchmark->filepath);
+}
+
+void bench_record_journal_turn(void * data) {
+    Board_Benchmark * benchmark = data;
+    for (int i = 0; i < 1000; i++) {
+        record_journal_turn(benchmark->dungeon);
+    }
+}
+
+// The game loop has already taken the player's turn out of the queue when the
+// stairs key is handled, and change_level gives it back on the new level
+void take_benchmark_stairs(Dungeon * dungeon, int depth) {
+    reset_arena(dungeon->turn_arena);
+    extract_min(dungeon->game_queue);
+    change_level(dungeon, depth);
+}
+
+// Goes back and forth between two levels that are both already cached
+void bench_change_level(void * data) {
+    Board_Benchmark * benchmark = data;
+    Dungeon * dungeon = benchmark->dungeon;
+    for (int i = 0; i < 2; i++) {
+        take_benchmark_stairs(dungeon, 1 - dungeon->depth);
+    }
+}
+
+// Empties the level cache so the next depth down is always a new level, and
+// lets the level worker finish building it when it is in use. The worker is
+// joined first too, since prepare_next_levels hands it nothing while it is
+// still busy with the last level's neighbours.
+void setup_next_level(void * data) {
+    Board_Benchmark * benchmark = data;
+    Dungeon * dungeon = benchmark->dungeon;
+    if (dungeon->level_cache) {
+        free_level_cache(dungeon->level_cache);
+        dungeon->level_cache = NULL;
+    }
+    if (dungeon->level_worker) {
+        thread_pool_wait(dungeon->level_worker);
     }
-    monsters[index].x = new_coord.x;
-    monsters[index].y = new_coord.y;
-    board[new_coord.y][new_coord.x].has_monster = 1;
+    prepare_next_levels(dungeon);
+    if (dungeon->level_worker) {
+        thread_pool_wait(dungeon->level_worker);
+    }
+}
+
+void bench_next_level(void * data) {
+    Board_Benchmark * benchmark = data;
+    take_benchmark_stairs(benchmark->dungeon, benchmark->dungeon->depth + 1);
+}
+
+void setup_load_board(void * data) {
+    Board_Benchmark * benchmark = data;
+    reset_level_arena(benchmark->dungeon);
+}
+
+void bench_load_board(void * data) {
+    Board_Benchmark * benchmark = data;
+    load_board_from(benchmark->dungeon, benchmark->filepath);
+}
+
+void run_queue_benchmarks(int size) {
+    Queue_Benchmark benchmark;
+    benchmark.size = size;
+    benchmark.queue = malloc(queue_size_in_bytes(size));
+    benchmark.priorities = malloc(sizeof(int) * size);
+    Rng rng;
+    rng_seed(&rng, BENCHMARK_SEED, size);
+    for (int i = 0; i < size; i++) {
+        benchmark.priorities[i] = rng_int(&rng, 1, 1000000);
+    }
+    char name[64];
+    sprintf(name, "insert_with_priority/%d", size);
+    run_benchmark(name, setup_empty_queue, bench_insert_with_priority, &benchmark, size, 200);
+    sprintf(name, "extract_min/%d", size);
+    run_benchmark(name, setup_full_queue, bench_extract_min, &benchmark, size, 200);
+    sprintf(name, "decrease_priority/%d", size);
+    run_benchmark(name, setup_full_queue, bench_decrease_priority, &benchmark, size, 200);
+    free(benchmark.priorities);
+    free(benchmark.queue);
+}
+
+// Draws into a screen whose output goes to /dev/null, so only building the
+// view is measured and nothing reaches the real terminal.
+void run_offscreen_view_benchmark(Board_Benchmark * benchmark) {
+    char * term = getenv("TERM");
+    if (term == NULL) {
+        term = "vt100";
+    }
+    FILE * output = fopen("/dev/null", "w");
+    FILE * input = fopen("/dev/null", "r");
+    SCREEN * screen = newterm(term, output, input);
+    if (screen == NULL) {
+        printf("%-40s skipped, cannot open terminal '%s'\n", "update_board_view", term);
+    }
+    else {
+        invalidate_board_view();
+        run_benchmark("update_board_view/full", setup_invalid_board_view, bench_update_board_view, benchmark, 1, 1000);
+        run_benchmark("update_board_view/unchanged", NULL, bench_update_board_view, benchmark, 1, 1000);
+        endwin();
+        delscreen(screen);
+    }
+    fclose(input);
+    fclose(output);
+}
+
+void run_benchmarks() {
+    print_benchmark_header();
+    run_queue_benchmarks(256);
+    run_queue_benchmarks(4096);
+    run_queue_benchmarks(FRONTIER_SIZE);
+
+    char filename[] = "bench_dungeon";
+    Board_Benchmark benchmark;
+    benchmark.dungeon = create_new_dungeon(NUMBER_OF_ROOMS, DEFAULT_NUMBER_OF_MONSTERS);
+    benchmark.filepath = malloc(strlen(filename) + strlen(RLG_DIRECTORY) + 1);
+    strcpy(benchmark.filepath, RLG_DIRECTORY);
+    strcat(benchmark.filepath, filename);
+
+    run_benchmark("generate_new_board", setup_benchmark_board, bench_generate_new_board, &benchmark, 1, 100);
+    int number_of_rooms = NUMBER_OF_ROOMS;
+    NUMBER_OF_ROOMS = MAX_NUMBER_OF_ROOMS;
+    run_benchmark("generate_new_board/max_rooms", setup_benchmark_board, bench_generate_new_board, &benchmark, 1, 100);
+    NUMBER_OF_ROOMS = number_of_rooms;
+    setup_benchmark_board(&benchmark);
+    generate_new_board(benchmark.dungeon);
+
+    USE_BUCKET_QUEUE = 1;
+    run_benchmark("set_tunneling_distance_to_player/bucket", NULL, bench_tunneling_distance, &benchmark, 1, 200);
+    USE_BUCKET_QUEUE = 0;
+    run_benchmark("set_tunneling_distance_to_player/heap", NULL, bench_tunneling_distance, &benchmark, 1, 200);
+    USE_BUCKET_QUEUE = 1;
+    run_benchmark("set_non_tunneling_distance_to_player", NULL, bench_non_tunneling_distance, &benchmark, 1, 200);
+    int use_map_workers = USE_MAP_WORKERS;
+    USE_MAP_WORKERS = 0;
+    run_benchmark("update_distance_maps_if_stale/serial", setup_stale_distance_maps, bench_update_distance_maps, &benchmark, 1, 200);
+    USE_MAP_WORKERS = 1;
+    run_benchmark("update_distance_maps_if_stale/workers", setup_stale_distance_maps, bench_update_distance_maps, &benchmark, 1, 200);
+    USE_MAP_WORKERS = use_map_workers;
+
+    run_offscreen_view_benchmark(&benchmark);
+
+    take_benchmark_stairs(benchmark.dungeon, 1);
+    run_benchmark("change_level/cached", NULL, bench_change_level, &benchmark, 2, 200);
+    int use_level_worker = USE_LEVEL_WORKER;
+    USE_LEVEL_WORKER = 0;
+    run_benchmark("change_level/new", setup_next_level, bench_next_level, &benchmark, 1, 200);
+    USE_LEVEL_WORKER = 1;
+    run_benchmark("change_level/prepared", setup_next_level, bench_next_level, &benchmark, 1, 200);
+    USE_LEVEL_WORKER = use_level_worker;
+
+    run_benchmark("save_game", NULL, bench_save_game, &benchmark, 1, 200);
+    run_benchmark("load_game", setup_load_board, bench_load_board, &benchmark, 1, 200);
+    run_benchmark("save_board", NULL, bench_save_board, &benchmark, 1, 200);
+    char journal_filename[] = "bench_journal";
+    char * journal_path = malloc(strlen(journal_filename) + strlen(RLG_DIRECTORY) + 1);
+    strcpy(journal_path, RLG_DIRECTORY);
+    strcat(journal_path, journal_filename);
+    game_journal = create_journal(journal_path, JOURNAL_MARKER, JOURNAL_MARKER_SIZE);
+    if (game_journal) {
+        run_benchmark("record_journal_turn", NULL, bench_record_journal_turn, &benchmark, 1000, 200);
+        close_journal(game_journal);
+        game_journal = NULL;
+    }
+    remove(journal_path);
+    free(journal_path);
+    run_benchmark("load_board", setup_load_board, bench_load_board, &benchmark, 1, 200);
+    remove(benchmark.filepath);
+    free(benchmark.filepath);
+    free_dungeon(benchmark.dungeon);
 }
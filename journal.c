@@ -0,0 +1,96 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "journal.h"
+
+#define JOURNAL_SYNC_NANOSECONDS 1000000000LL
+
+static long long nanoseconds_between(struct timespec start, struct timespec end) {
+    return ((end.tv_sec - start.tv_sec) * 1000000000LL) + (end.tv_nsec - start.tv_nsec);
+}
+
+static Journal *create_journal_for(int fd) {
+    Journal *journal = malloc(sizeof(Journal));
+    journal->fd = fd;
+    journal->length = 0;
+    clock_gettime(CLOCK_MONOTONIC, &journal->last_sync);
+    return journal;
+}
+
+// Writes start to a temporary file and renames it over filepath, so a crash
+// leaves either the old journal or the new one, never a mix of the two.
+Journal *create_journal(char *filepath, const void *start, size_t start_size) {
+    char *temporary_path = malloc(strlen(filepath) + 5);
+    strcpy(temporary_path, filepath);
+    strcat(temporary_path, ".tmp");
+    int fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) {
+        free(temporary_path);
+        return NULL;
+    }
+    if (write(fd, start, start_size) != start_size || fsync(fd) == -1 || rename(temporary_path, filepath) == -1) {
+        close(fd);
+        remove(temporary_path);
+        free(temporary_path);
+        return NULL;
+    }
+    free(temporary_path);
+    return create_journal_for(fd);
+}
+
+// Carries on appending to an existing journal, dropping anything past
+// valid_size such as a record cut short by a crash.
+Journal *reopen_journal(char *filepath, size_t valid_size) {
+    int fd = open(filepath, O_WRONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+    if (ftruncate(fd, valid_size) == -1 || lseek(fd, 0, SEEK_END) == -1) {
+        close(fd);
+        return NULL;
+    }
+    return create_journal_for(fd);
+}
+
+int journal_append(Journal *journal, const void *record, size_t size) {
+    if (journal->length + size > JOURNAL_BUFFER_SIZE && !flush_journal(journal)) {
+        return 0;
+    }
+    memcpy(journal->buffer + journal->length, record, size);
+    journal->length += size;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (nanoseconds_between(journal->last_sync, now) >= JOURNAL_SYNC_NANOSECONDS) {
+        return sync_journal(journal);
+    }
+    return 1;
+}
+
+// Hands the buffered records to the kernel, which is enough for them to
+// survive the process dying; only sync_journal makes them survive the machine.
+int flush_journal(Journal *journal) {
+    if (journal->length == 0) {
+        return 1;
+    }
+    ssize_t written = write(journal->fd, journal->buffer, journal->length);
+    if (written != journal->length) {
+        return 0;
+    }
+    journal->length = 0;
+    return 1;
+}
+
+int sync_journal(Journal *journal) {
+    clock_gettime(CLOCK_MONOTONIC, &journal->last_sync);
+    return flush_journal(journal) && fsync(journal->fd) == 0;
+}
+
+int close_journal(Journal *journal) {
+    int is_synced = sync_journal(journal);
+    close(journal->fd);
+    free(journal);
+    return is_synced;
+}
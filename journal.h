@@ -0,0 +1,27 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define JOURNAL_BUFFER_SIZE 4096
+
+// Append-only file of small records. Appends collect in buffer and reach the
+// file when it fills or on flush_journal, and the file is fsynced at most once
+// per second, so an append is normally just a copy into the buffer.
+typedef struct {
+    int fd;
+    size_t length;
+    struct timespec last_sync;
+    uint8_t buffer[JOURNAL_BUFFER_SIZE];
+} Journal;
+
+Journal * create_journal(char *filepath, const void *start, size_t start_size);
+Journal * reopen_journal(char *filepath, size_t valid_size);
+int journal_append(Journal *journal, const void *record, size_t size);
+int flush_journal(Journal *journal);
+int sync_journal(Journal *journal);
+int close_journal(Journal *journal);
+
+#endif
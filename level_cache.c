@@ -0,0 +1,190 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "level_cache.h"
+#include "run_length.h"
+
+static char *get_spill_path(Level_Cache *cache, int depth) {
+    char *path = malloc(strlen(cache->spill_prefix) + 16);
+    sprintf(path, "%s%d", cache->spill_prefix, depth);
+    return path;
+}
+
+static void unlink_level(Level_Cache *cache, Cached_Level *level) {
+    if (level->newer) {
+        level->newer->older = level->older;
+    }
+    else {
+        cache->newest = level->older;
+    }
+    if (level->older) {
+        level->older->newer = level->newer;
+    }
+    else {
+        cache->oldest = level->newer;
+    }
+}
+
+static Cached_Level *find_level(Level_Cache *cache, int depth) {
+    for (Cached_Level *level = cache->newest; level; level = level->older) {
+        if (level->depth == depth) {
+            return level;
+        }
+    }
+    return NULL;
+}
+
+// Spill files hold the level's size followed by its run-length encoded bytes.
+// A level that cannot be written out is dropped, which only means it will be
+// built again from scratch if it is asked for.
+static void spill_level(Level_Cache *cache, Cached_Level *level) {
+    char *path = get_spill_path(cache, level->depth);
+    uint8_t *file = malloc(sizeof(size_t) + run_length_encoded_size_bound(level->size));
+    memcpy(file, &level->size, sizeof(size_t));
+    size_t file_size = sizeof(size_t) + run_length_encode(level->bytes, level->size, file + sizeof(size_t));
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    int is_spilled = 0;
+    if (fd != -1) {
+        is_spilled = write(fd, file, file_size) == file_size;
+        close(fd);
+    }
+    free(file);
+    free(level->bytes);
+    level->bytes = NULL;
+    cache->used -= level->size;
+    if (!is_spilled) {
+        remove(path);
+        unlink_level(cache, level);
+        free(level);
+    }
+    free(path);
+}
+
+static uint8_t *read_spilled_level(Level_Cache *cache, int depth, size_t *size) {
+    char *path = get_spill_path(cache, depth);
+    int fd = open(path, O_RDONLY);
+    uint8_t *bytes = NULL;
+    struct stat file_stat;
+    if (fd != -1 && fstat(fd, &file_stat) == 0 && file_stat.st_size >= sizeof(size_t)) {
+        uint8_t *file = malloc(file_stat.st_size);
+        if (read(fd, file, file_stat.st_size) == file_stat.st_size) {
+            memcpy(size, file, sizeof(size_t));
+            bytes = malloc(*size);
+            if (!run_length_decode(file + sizeof(size_t), file_stat.st_size - sizeof(size_t), bytes, *size)) {
+                free(bytes);
+                bytes = NULL;
+            }
+        }
+        free(file);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    free(path);
+    return bytes;
+}
+
+Level_Cache *create_new_level_cache(size_t capacity, char *spill_prefix) {
+    Level_Cache *cache = malloc(sizeof(Level_Cache));
+    cache->newest = NULL;
+    cache->oldest = NULL;
+    cache->used = 0;
+    cache->capacity = capacity;
+    cache->spill_prefix = malloc(strlen(spill_prefix) + 1);
+    strcpy(cache->spill_prefix, spill_prefix);
+    return cache;
+}
+
+void free_level_cache(Level_Cache *cache) {
+    Cached_Level *level = cache->newest;
+    while (level) {
+        Cached_Level *older = level->older;
+        if (level->bytes) {
+            free(level->bytes);
+        }
+        else {
+            char *path = get_spill_path(cache, level->depth);
+            remove(path);
+            free(path);
+        }
+        free(level);
+        level = older;
+    }
+    free(cache->spill_prefix);
+    free(cache);
+}
+
+// Takes ownership of bytes, which must come from malloc
+void level_cache_put(Level_Cache *cache, int depth, uint8_t *bytes, size_t size) {
+    size_t old_size;
+    free(level_cache_take(cache, depth, &old_size));
+    Cached_Level *level = malloc(sizeof(Cached_Level));
+    level->depth = depth;
+    level->bytes = bytes;
+    level->size = size;
+    level->newer = NULL;
+    level->older = cache->newest;
+    if (cache->newest) {
+        cache->newest->newer = level;
+    }
+    else {
+        cache->oldest = level;
+    }
+    cache->newest = level;
+    cache->used += size;
+
+    Cached_Level *candidate = cache->oldest;
+    while (cache->used > cache->capacity && candidate) {
+        Cached_Level *newer = candidate->newer;
+        if (candidate->bytes) {
+            spill_level(cache, candidate);
+        }
+        candidate = newer;
+    }
+}
+
+int level_cache_has(Level_Cache *cache, int depth) {
+    return find_level(cache, depth) != NULL;
+}
+
+// Returns the level stored for depth, which the caller frees, or NULL if
+// there isn't one. size is set to its length in bytes.
+uint8_t *level_cache_take(Level_Cache *cache, int depth, size_t *size) {
+    Cached_Level *level = find_level(cache, depth);
+    if (!level) {
+        return NULL;
+    }
+    unlink_level(cache, level);
+    uint8_t *bytes = level->bytes;
+    if (bytes) {
+        *size = level->size;
+        cache->used -= level->size;
+    }
+    else {
+        char *path = get_spill_path(cache, depth);
+        bytes = read_spilled_level(cache, depth, size);
+        remove(path);
+        free(path);
+    }
+    free(level);
+    return bytes;
+}
+
+// Like level_cache_take, but the level stays where it is in the cache
+uint8_t *level_cache_copy(Level_Cache *cache, int depth, size_t *size) {
+    Cached_Level *level = find_level(cache, depth);
+    if (!level) {
+        return NULL;
+    }
+    if (!level->bytes) {
+        return read_spilled_level(cache, depth, size);
+    }
+    uint8_t *bytes = malloc(level->size);
+    memcpy(bytes, level->bytes, level->size);
+    *size = level->size;
+    return bytes;
+}
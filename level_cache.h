@@ -0,0 +1,35 @@
+#ifndef LEVEL_CACHE_H
+#define LEVEL_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct Cached_Level {
+    int depth;
+    uint8_t *bytes;
+    size_t size;
+    struct Cached_Level *newer;
+    struct Cached_Level *older;
+} Cached_Level;
+
+// Levels keyed by depth, most recently stored first. Once the levels
+// held in memory add up to more than capacity bytes, the least recently
+// stored ones are run-length encoded into a file named spill_prefix followed
+// by their depth and their bytes freed (bytes is then NULL), so nothing is
+// lost, only slower to get back. Taking a level removes it from the cache.
+typedef struct {
+    Cached_Level *newest;
+    Cached_Level *oldest;
+    size_t used;
+    size_t capacity;
+    char *spill_prefix;
+} Level_Cache;
+
+Level_Cache * create_new_level_cache(size_t capacity, char *spill_prefix);
+void free_level_cache(Level_Cache *cache);
+void level_cache_put(Level_Cache *cache, int depth, uint8_t *bytes, size_t size);
+int level_cache_has(Level_Cache *cache, int depth);
+uint8_t * level_cache_take(Level_Cache *cache, int depth, size_t *size);
+uint8_t * level_cache_copy(Level_Cache *cache, int depth, size_t *size);
+
+#endif
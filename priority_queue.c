@@ -1,102 +1,128 @@
 #include <stdlib.h>
 #include <math.h>
 #include <stdint.h>
+#include <string.h>
 
-struct Coordinate {
-    uint8_t x;
-    uint8_t y;
-};
+#include "priority_queue.h"
 
-typedef struct {
-    int distance;
-    int priority;
-    struct Coordinate coord;
-} Node;
+// Every possible uint8_t coordinate gets a slot in the position index
+#define POSITION_INDEX_SIZE (1 << 16)
 
-typedef struct {
-    int length;
-    Node * nodes;
-} Queue;
+static int coordinate_key(struct Coordinate coord) {
+    return (coord.y << 8) | coord.x;
+}
 
-Queue *create_new_queue(int max_size) {
-   Queue *q = malloc(sizeof(Queue));
-   q->length = 0;
-   q->nodes = malloc(sizeof(Node) * max_size);
-   return q;
+// Ties go to the most recently inserted node, which is the order the old
+// sorted-array queue handed them out in.
+static int node_comes_before(Node node1, Node node2) {
+    if (node1.priority != node2.priority) {
+        return node1.priority < node2.priority;
+    }
+    return node1.sequence > node2.sequence;
 }
 
-void insert_with_priority(Queue *q, struct Coordinate coord, int priority) {
-    Node node;
-    node.coord = coord;
-    node.priority = priority;
-    if (q->length == 0) {
-        q->nodes[0] = node;
-        q->length ++;
-        return;
+static void place_node(Queue *q, int index, Node node) {
+    q->nodes[index] = node;
+    q->positions[coordinate_key(node.coord)] = index + 1;
+}
+
+static void sift_up(Queue *q, int index) {
+    Node node = q->nodes[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!node_comes_before(node, q->nodes[parent])) {
+            break;
+        }
+        place_node(q, index, q->nodes[parent]);
+        index = parent;
     }
-    int i;
-    int added = 0;
-    for (i = 0; i < q->length; i++) {
-        Node existing_node = q->nodes[i];
-        if (priority <= existing_node.priority) {
-            for (int j = q->length; j >= i; j--) {
-                Node node_to_shift = q->nodes[j];
-                q->nodes[j+1] = node_to_shift;
-            }
-            q->nodes[i] = node;
-            added = 1;
+    place_node(q, index, node);
+}
+
+static void sift_down(Queue *q, int index) {
+    Node node = q->nodes[index];
+    while (1) {
+        int child = (index * 2) + 1;
+        if (child >= q->length) {
+            break;
+        }
+        if (child + 1 < q->length && node_comes_before(q->nodes[child + 1], q->nodes[child])) {
+            child ++;
+        }
+        if (!node_comes_before(q->nodes[child], node)) {
             break;
         }
+        place_node(q, index, q->nodes[child]);
+        index = child;
     }
-    if (!added) {
-        q->nodes[q->length] = node;
+    place_node(q, index, node);
+}
+
+size_t queue_size_in_bytes(int max_size) {
+    return sizeof(Queue) + (sizeof(Node) * max_size) + (sizeof(int) * POSITION_INDEX_SIZE);
+}
+
+// Lays the queue out in one block of queue_size_in_bytes(max_size) bytes so
+// it can live in memory the caller owns
+Queue *create_new_queue_in(void *memory, int max_size) {
+   Queue *q = memory;
+   q->length = 0;
+   q->max_size = max_size;
+   q->insertions = 0;
+   q->nodes = (Node *) (q + 1);
+   q->positions = (int *) (q->nodes + max_size);
+   memset(q->positions, 0, sizeof(int) * POSITION_INDEX_SIZE);
+   return q;
+}
+
+Queue *create_new_queue(int max_size) {
+   return create_new_queue_in(malloc(queue_size_in_bytes(max_size)), max_size);
+}
+
+void free_queue(Queue *q) {
+    free(q);
+}
+
+// Returns 0 without inserting anything if the queue is already full
+int insert_with_priority(Queue *q, struct Coordinate coord, int priority) {
+    if (q->length == q->max_size) {
+        return 0;
     }
+    Node node;
+    node.distance = 0;
+    node.coord = coord;
+    node.priority = priority;
+    node.sequence = q->insertions;
+    q->insertions ++;
+    q->nodes[q->length] = node;
     q->length ++;
+    sift_up(q, q->length - 1);
+    return 1;
 }
 
 Node extract_min(Queue * q) {
     Node min = q->nodes[0];
-    for(int i = 1; i < q->length; i++) {
-        Node node = q->nodes[i];
-        q->nodes[i-1] = node;
+    int key = coordinate_key(min.coord);
+    if (q->positions[key] == 1) {
+        q->positions[key] = 0;
     }
     q->length --;
+    if (q->length > 0) {
+        q->nodes[0] = q->nodes[q->length];
+        sift_down(q, 0);
+    }
     return min;
 }
 
-int nodes_are_equal(Node node1, Node node2) {
-    return node1.coord.x == node2.coord.x && node1.coord.y == node2.coord.y;
-}
-
 void decrease_priority(Queue *q, struct Coordinate coord, int priority) {
-    Node node;
-    node.coord = coord;
-    node.priority = priority;
-    int old_index;
-    int prev_pri = 0;
-    int found = 0;
-    for (old_index = 0; old_index < q->length; old_index++) {
-       Node existing_node = q->nodes[old_index];
-       if (coord.x == existing_node.coord.x && coord.y == existing_node.coord.y){
-           prev_pri = existing_node.priority;
-           found = 1;
-           break;
-       }
-    }
-    if (!found) {
+    int index = q->positions[coordinate_key(coord)] - 1;
+    if (index < 0 || index >= q->length) {
         return;
     }
-    int new_index;
-    for (new_index = 0; new_index < q->length; new_index++) {
-        Node existing_node = q->nodes[new_index];
-        if (priority < existing_node.priority) {
-            for (int j = old_index - 1; j >= new_index; j--) {
-                Node node_to_shift = q->nodes[j];
-                q->nodes[j+1] = node_to_shift;
-            }
-            q->nodes[new_index] = node;
-            break;
-        }
+    Node node = q->nodes[index];
+    if (node.coord.x != coord.x || node.coord.y != coord.y || priority >= node.priority) {
+        return;
     }
-
+    q->nodes[index].priority = priority;
+    sift_up(q, index);
 }
@@ -1,3 +1,9 @@
+#ifndef PRIORITY_QUEUE_H
+#define PRIORITY_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
 struct Coordinate {
     uint8_t x;
     uint8_t y;
@@ -6,15 +12,27 @@ struct Coordinate {
 typedef struct {
     int distance;
     int priority;
+    unsigned int sequence;
     struct Coordinate coord;
 } Node;
 
+// Binary min-heap. positions maps a coordinate to its slot in nodes (plus one,
+// zero meaning "not queued") so decrease_priority doesn't have to search.
+// decrease_priority assumes a coordinate is queued at most once.
 typedef struct {
     int length;
+    int max_size;
+    unsigned int insertions;
     Node * nodes;
+    int * positions;
 } Queue;
 
+size_t queue_size_in_bytes(int max_size);
+Queue * create_new_queue_in(void *memory, int max_size);
 Queue * create_new_queue(int max_size);
-void insert_with_priority(Queue *q, struct Coordinate coord, int priority);
+void free_queue(Queue *q);
+int insert_with_priority(Queue *q, struct Coordinate coord, int priority);
 Node extract_min(Queue * q);
 void decrease_priority(Queue *q, struct Coordinate coord, int priority);
+
+#endif
@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "rng.h"
+
+#define PCG_MULTIPLIER 6364136223846793005ULL
+#define FILL_LANES 8
+#define FILL_BLOCK_SIZE (FILL_LANES * sizeof(uint16_t))
+
+// GCC vector types: arithmetic on these compiles to SIMD instructions
+typedef uint32_t Fill_Lanes __attribute__((vector_size(FILL_LANES * sizeof(uint32_t))));
+typedef uint16_t Fill_Halves __attribute__((vector_size(FILL_LANES * sizeof(uint32_t))));
+typedef uint32_t Fill_Wide_Halves __attribute__((vector_size(FILL_LANES * sizeof(uint32_t) * 2)));
+typedef uint8_t Fill_Bytes __attribute__((vector_size(FILL_BLOCK_SIZE)));
+
+void rng_seed(Rng *rng, uint64_t seed, uint64_t stream) {
+    rng->state = 0;
+    rng->increment = (stream << 1) | 1;
+    rng_next(rng);
+    rng->state += seed;
+    rng_next(rng);
+}
+
+// Seeds a child generator from the parent's output, so a sequence of splits
+// is as reproducible as the parent itself.
+Rng rng_split(Rng *parent, uint64_t stream) {
+    uint64_t high = rng_next(parent);
+    uint64_t low = rng_next(parent);
+    uint64_t seed = (high << 32) | low;
+    Rng child;
+    rng_seed(&child, seed, stream);
+    return child;
+}
+
+uint32_t rng_next(Rng *rng) {
+    uint64_t old_state = rng->state;
+    rng->state = (old_state * PCG_MULTIPLIER) + rng->increment;
+    uint32_t xorshifted = ((old_state >> 18) ^ old_state) >> 27;
+    uint32_t rotation = old_state >> 59;
+    return (xorshifted >> rotation) | (xorshifted << ((-rotation) & 31));
+}
+
+// Uniform in [min_num, max_num], both ends included
+int rng_int(Rng *rng, int min_num, int max_num) {
+    if (max_num <= min_num) {
+        return min_num;
+    }
+    uint64_t range = (uint64_t) ((int64_t) max_num - min_num) + 1;
+    return min_num + (int) ((rng_next(rng) * range) >> 32);
+}
+
+// xoshiro128+ run on FILL_LANES independent states at once, seeded from rng.
+// Each step yields FILL_BLOCK_SIZE bytes. Every byte is scaled from 16 random
+// bits into [min_num, max_num] with a multiply and shift, which keeps the
+// bias under half a percent without a division.
+void rng_fill_bytes(Rng *rng, uint8_t *bytes, size_t length, uint8_t min_num, uint8_t max_num) {
+    Fill_Lanes state[4];
+    for (int i = 0; i < 4; i++) {
+        for (int lane = 0; lane < FILL_LANES; lane++) {
+            state[i][lane] = rng_next(rng) | 1;
+        }
+    }
+    uint32_t range = (uint32_t) (max_num - min_num) + 1;
+    Fill_Wide_Halves wide_range = (Fill_Wide_Halves) {0} + range;
+    Fill_Wide_Halves wide_min = (Fill_Wide_Halves) {0} + min_num;
+    size_t offset = 0;
+    while (offset < length) {
+        Fill_Lanes result = state[0] + state[3];
+        Fill_Lanes t = state[1] << 9;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = (state[3] << 11) | (state[3] >> 21);
+
+        Fill_Wide_Halves wide = __builtin_convertvector((Fill_Halves) result, Fill_Wide_Halves);
+        Fill_Bytes scaled = __builtin_convertvector(((wide * wide_range) >> 16) + wide_min, Fill_Bytes);
+        size_t count = length - offset;
+        if (count > FILL_BLOCK_SIZE) {
+            count = FILL_BLOCK_SIZE;
+        }
+        memcpy(bytes + offset, &scaled, count);
+        offset += count;
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// PCG32 generator. Generators seeded with the same seed but different
+// streams produce independent sequences, so each subsystem (or each worker
+// thread) can own one and still be reproducible from a single seed.
+typedef struct {
+    uint64_t state;
+    uint64_t increment;
+} Rng;
+
+void rng_seed(Rng *rng, uint64_t seed, uint64_t stream);
+Rng rng_split(Rng *parent, uint64_t stream);
+uint32_t rng_next(Rng *rng);
+int rng_int(Rng *rng, int min_num, int max_num);
+void rng_fill_bytes(Rng *rng, uint8_t *bytes, size_t length, uint8_t min_num, uint8_t max_num);
+
+#endif
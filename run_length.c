@@ -0,0 +1,71 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "run_length.h"
+
+#define MAX_RUN 128
+#define MIN_RUN 3
+
+static size_t run_length_at(const uint8_t *bytes, size_t length, size_t start) {
+    size_t run = 1;
+    while (start + run < length && run < MAX_RUN && bytes[start + run] == bytes[start]) {
+        run ++;
+    }
+    return run;
+}
+
+size_t run_length_encoded_size_bound(size_t length) {
+    return length + (length / MAX_RUN) + 1;
+}
+
+size_t run_length_encode(const uint8_t *bytes, size_t length, uint8_t *encoded) {
+    size_t in = 0;
+    size_t out = 0;
+    while (in < length) {
+        size_t run = run_length_at(bytes, length, in);
+        if (run >= MIN_RUN) {
+            encoded[out++] = 257 - run;
+            encoded[out++] = bytes[in];
+            in += run;
+            continue;
+        }
+        size_t start = in;
+        while (in < length && in - start < MAX_RUN && run_length_at(bytes, length, in) < MIN_RUN) {
+            in ++;
+        }
+        encoded[out++] = in - start - 1;
+        memcpy(encoded + out, bytes + start, in - start);
+        out += in - start;
+    }
+    return out;
+}
+
+// Returns 1 if encoded expands to exactly length bytes, 0 if it is malformed
+int run_length_decode(const uint8_t *encoded, size_t encoded_length, uint8_t *bytes, size_t length) {
+    size_t in = 0;
+    size_t out = 0;
+    while (in < encoded_length) {
+        uint8_t control = encoded[in++];
+        if (control < 128) {
+            size_t count = control + 1;
+            if (in + count > encoded_length || out + count > length) {
+                return 0;
+            }
+            memcpy(bytes + out, encoded + in, count);
+            in += count;
+            out += count;
+        }
+        else if (control > 128) {
+            size_t count = 257 - control;
+            if (in >= encoded_length || out + count > length) {
+                return 0;
+            }
+            memset(bytes + out, encoded[in++], count);
+            out += count;
+        }
+        else {
+            return 0;
+        }
+    }
+    return out == length;
+}
@@ -0,0 +1,16 @@
+#ifndef RUN_LENGTH_H
+#define RUN_LENGTH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// PackBits-style run-length encoding. A control byte c below 128 is followed
+// by c + 1 bytes copied as they are; a control byte c above 128 is followed by
+// one byte repeated 257 - c times. Data without runs grows by at most one byte
+// in 128, so random rock hardness costs almost nothing extra while floors,
+// walls and the type plane shrink to a few bytes per run.
+size_t run_length_encoded_size_bound(size_t length);
+size_t run_length_encode(const uint8_t *bytes, size_t length, uint8_t *encoded);
+int run_length_decode(const uint8_t *encoded, size_t encoded_length, uint8_t *bytes, size_t length);
+
+#endif
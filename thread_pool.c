@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "thread_pool.h"
+
+static void *run_worker(void *data) {
+    Thread_Pool *pool = data;
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (!pool->length && !pool->is_shutting_down) {
+            pthread_cond_wait(&pool->task_available, &pool->lock);
+        }
+        if (!pool->length) {
+            break;
+        }
+        Task task = pool->tasks[pool->head];
+        pool->head = (pool->head + 1) % pool->max_tasks;
+        pool->length --;
+        pthread_mutex_unlock(&pool->lock);
+
+        task.function(task.data);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->unfinished --;
+        if (!pool->unfinished) {
+            pthread_cond_broadcast(&pool->all_finished);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+Thread_Pool *create_new_thread_pool(int number_of_workers, int max_tasks) {
+    Thread_Pool *pool = malloc(sizeof(Thread_Pool));
+    pool->number_of_workers = number_of_workers;
+    pool->max_tasks = max_tasks;
+    pool->head = 0;
+    pool->length = 0;
+    pool->unfinished = 0;
+    pool->is_shutting_down = 0;
+    pool->tasks = malloc(sizeof(Task) * max_tasks);
+    pool->workers = malloc(sizeof(pthread_t) * number_of_workers);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->task_available, NULL);
+    pthread_cond_init(&pool->all_finished, NULL);
+    for (int i = 0; i < number_of_workers; i++) {
+        if (pthread_create(&pool->workers[i], NULL, run_worker, pool)) {
+            printf("Cannot start thread pool worker %d\n", i);
+            exit(1);
+        }
+    }
+    return pool;
+}
+
+// Workers finish whatever is still queued before they exit
+void free_thread_pool(Thread_Pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->is_shutting_down = 1;
+    pthread_cond_broadcast(&pool->task_available);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->number_of_workers; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+    pthread_cond_destroy(&pool->all_finished);
+    pthread_cond_destroy(&pool->task_available);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool->tasks);
+    free(pool);
+}
+
+void thread_pool_submit(Thread_Pool *pool, Task_Function function, void *data) {
+    pthread_mutex_lock(&pool->lock);
+    if (pool->length == pool->max_tasks) {
+        printf("Thread pool is full: %d tasks queued\n", pool->max_tasks);
+        exit(1);
+    }
+    Task task;
+    task.function = function;
+    task.data = data;
+    pool->tasks[(pool->head + pool->length) % pool->max_tasks] = task;
+    pool->length ++;
+    pool->unfinished ++;
+    pthread_cond_signal(&pool->task_available);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_wait(Thread_Pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->unfinished) {
+        pthread_cond_wait(&pool->all_finished, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Like thread_pool_wait, but returns straight away with whether everything
+// submitted has finished
+int thread_pool_is_idle(Thread_Pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    int is_idle = !pool->unfinished;
+    pthread_mutex_unlock(&pool->lock);
+    return is_idle;
+}
@@ -0,0 +1,37 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+
+typedef void (*Task_Function)(void *data);
+
+typedef struct {
+    Task_Function function;
+    void *data;
+} Task;
+
+// Fixed set of worker threads that live until free_thread_pool, pulling tasks
+// from a ring buffer of max_tasks slots. thread_pool_wait blocks until every
+// submitted task has finished, so a caller can fan work out and join it
+// without starting threads each time.
+typedef struct {
+    int number_of_workers;
+    int max_tasks;
+    int head;
+    int length;
+    int unfinished;
+    int is_shutting_down;
+    Task *tasks;
+    pthread_t *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t task_available;
+    pthread_cond_t all_finished;
+} Thread_Pool;
+
+Thread_Pool * create_new_thread_pool(int number_of_workers, int max_tasks);
+void free_thread_pool(Thread_Pool *pool);
+void thread_pool_submit(Thread_Pool *pool, Task_Function function, void *data);
+void thread_pool_wait(Thread_Pool *pool);
+int thread_pool_is_idle(Thread_Pool *pool);
+
+#endif